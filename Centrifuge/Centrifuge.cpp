@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-//#include <vector>
+#include <string>
+#include <vector>
 #include <algorithm>
 
 #include <GL/glew.h>
@@ -18,41 +20,67 @@ using namespace glm;
 #include "shader.hpp"
 #include "texture.hpp"
 #include "controls.hpp"
-
-// CPU representation of a particle
-struct Particle {
-	glm::vec3 pos, speed;
-	unsigned char r, g, b, a; // Color
-	float size, angle, weight;
-	float life; // Remaining life of the particle. if <0 : dead and unused.
-	float cameradistance; // *Squared* distance to the camera. if dead : -1.0f
-
-	bool operator<(const Particle& that) const {
-		// Sort in reverse order : far particles drawn first.
-		return this->cameradistance > that.cameradistance;
-	}
+#include "simulation.hpp"
+#include "gpusim.hpp"
+#include "culling.hpp"
+#include "packing.hpp"
+#include "scene.hpp"
+#include "trails.hpp"
+#include "pipeline.hpp"
+#include "timing.hpp"
+#include "history.hpp"
+#include "density.hpp"
+#include "sleep.hpp"
+#include "fluid.hpp"
+#include "stream.hpp"
+#include "replay.hpp"
+#include "governor.hpp"
+
+// Layout of a glMultiDrawArraysIndirect command
+struct DrawArraysIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint first;
+	GLuint baseInstance;
 };
-// ********** Ʋ **********
-const int MaxParticles = 5000;						// ը
-const float timeRatio = 0.1f;						// ʱ
-const float centrifugeSpeed = 8.0f;					// Ļת(rad/s)
-const float boomSpeed = 20.0f;						// ը(m/s)
-const float gravityAcceleraion = 9.81f * 1;			// ٶ
-const float frictionCoefficient = 0.01f * 0;		// Ħϵ
-// ********** Ʋ **********
-
-Particle ParticlesContainer[MaxParticles];
-bool startFlag = false; // Simulation start flag. If TRUE, simulation will begin
+
+// The callbacks only queue commands : the simulation, which may run on its own thread, applies them
 
 // OpenGL keyboard callback function
 void onKey(GLFWwindow* window, int key, int scancode, int action, int mods) {
 	if (action != GLFW_PRESS) return;
 	switch (key) {
 	case GLFW_KEY_SPACE:
-		startFlag = !startFlag;
+		pushCommand(CommandToggleStart);
 		break;
 	case GLFW_KEY_ENTER:
-		setNoninertialFlag(!getNoninertialFlag());
+		pushCommand(CommandToggleNoninertial);
+		break;
+	case GLFW_KEY_EQUAL:
+	case GLFW_KEY_KP_ADD:
+		pushCommand(CommandTimeWarp, 2.0);
+		break;
+	case GLFW_KEY_MINUS:
+	case GLFW_KEY_KP_SUBTRACT:
+		pushCommand(CommandTimeWarp, 0.5);
+		break;
+	case GLFW_KEY_D:
+		pushCommand(CommandToggleDensity);
+		break;
+	case GLFW_KEY_W:
+		pushCommand(CommandWakeParticles);
+		break;
+	case GLFW_KEY_V:
+		pushCommand(CommandToggleSplitView);
+		break;
+	case GLFW_KEY_P:
+		pushCommand(CommandTogglePause);
+		break;
+	case GLFW_KEY_LEFT:
+		pushCommand(CommandScrub, (mods & GLFW_MOD_SHIFT) ? -1.0 : -0.1);
+		break;
+	case GLFW_KEY_RIGHT:
+		pushCommand(CommandScrub, (mods & GLFW_MOD_SHIFT) ? 1.0 : 0.1);
 		break;
 	}
 	
@@ -63,32 +91,104 @@ void onKey(GLFWwindow* window, int key, int scancode, int action, int mods) {
 void onMouse(GLFWwindow* window, int button, int action, int mods) {
 	if (button == GLFW_MOUSE_BUTTON_LEFT) {
 		if (action == 0) {
-			setRotateFlag(false);
+			pushCommand(CommandRotate, 0.0);
 		}
 		else if (action == 1) {
-			setRotateFlag(true);
+			pushCommand(CommandRotate, 1.0);
 		}
 	} else if (button == GLFW_MOUSE_BUTTON_RIGHT) {
 		if (action == 0) {
-			setMoveFlag(false);
+			pushCommand(CommandMove, 0.0);
 		}
 		else if (action == 1) {
-			setMoveFlag(true);
+			pushCommand(CommandMove, 1.0);
 		}
 	}
 }
 
 // OpenGL scroll callback function
 void onScroll(GLFWwindow* window, double xoffset, double yoffset) {
-	AddScrollOffset(yoffset);
+	pushCommand(CommandScroll, xoffset, yoffset);
 }
 
-void SortParticles() {
-	std::sort(&ParticlesContainer[0], &ParticlesContainer[MaxParticles]);
-}
-
-int main(void)
+int main(int argc, char* argv[])
 {
+	// Command line options
+	bool gpuSimulationFlag = false; // --gpu-sim : integrate the particles on the GPU with transform feedback
+	bool validateGpuFlag = false; // --validate-gpu : compare the GPU engine against the CPU engine and exit
+	bool packedFlag = false; // --packed : upload 8-byte quantized instances instead of float position+size and color
+	bool cullFlag = true; // --no-cull : upload every live particle, even off screen or far away
+	bool pipelineFlag = true; // --serial : simulate on the GL thread instead of a dedicated simulation thread
+	bool timingFlag = false; // --timing : print the per-phase frame timing percentiles
+	const char* timingLogPath = NULL; // --timing-log <file.csv|file.json> : per-frame timing log, implies --timing
+	int diagnosticsInterval = 0; // --diagnostics <K> : check energy, momentum and angular momentum every K steps
+	double diagnosticsTolerance = 0.01; // --diagnostics-tolerance <t> : relative drift flagged by --diagnostics
+	bool shaderCacheFlag = true; // --no-shader-cache : always compile the shaders from source
+	int rotorCount = 1; // --rotors <N> : N independent centrifuges side by side, drawn with one multi-draw
+	double timeWarp = timeRatio; // --warp <x> : initial time warp (0.01 to 1000), + and - double or halve it at runtime
+	double substep = 1.0 / 60.0 * timeRatio; // --substep <s> : fixed integration step in simulated seconds, smaller for a smooth slow motion
+	double stepBudget = 0.012; // --step-budget <ms> : CPU time per frame for the substeps, the simulation falls behind beyond it
+	bool densityFlag = false; // --density : start with the particle density view (D toggles it)
+	bool splitFlag = false; // --split : start with the lab and the rotor views side by side (V toggles it)
+	int trailLength = 0; // --trails <N> : draw the last N positions of every particle (2 to 64)
+	int historyKeyframes = 64; // --history <N> : keyframes kept for rewind and scrub (arrows, P to pause), 0 : no history
+	int keyframeInterval = 600; // --keyframe-interval <steps> : substeps between keyframes, the most re-simulated by a scrub
+	bool sleepFlag = false; // --sleep <x0 y0 z0 x1 y1 z1> : region of interest, the particles leaving it or resting on its floor stop being stepped (W wakes them)
+	SleepRegion sleepRegion = { glm::vec3(0.0f), glm::vec3(0.0f), 0.5f }; // --sleep-speed <v> : speed below which a particle on the floor rests
+	bool fluidFlag = false; // --fluid : the particles are a liquid sample spun in a tube at the rim (SPH), instead of debris
+	const char* streamName = NULL; // --stream <name> : publish the live particles of every frame in the shared memory segment name, see stream.hpp
+	int streamSlots = 4; // --stream-slots <N> : frames kept in the shared memory ring (2 to 16)
+	const char* recordPath = NULL; // --record <file> : record the input of the run, see replay.hpp
+	const char* replayPath = NULL; // --replay <file> : replay a recorded input instead of the live one, and exit at its end
+	const char* cameraPathPath = NULL; // --camera-path <file> : drive the camera along keyframes instead of the mouse, and exit at its end
+	double targetFrameRate = 0.0; // --target-fps <f> : lower the drawing quality to hold f frames per second, see governor.hpp (turns the vertical sync off)
+	int multisampleCount = 4; // --samples <N> : MSAA samples of the window, 0 : none
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--gpu-sim") == 0) gpuSimulationFlag = true;
+		else if (strcmp(argv[i], "--validate-gpu") == 0) validateGpuFlag = true;
+		else if (strcmp(argv[i], "--packed") == 0) packedFlag = true;
+		else if (strcmp(argv[i], "--no-cull") == 0) cullFlag = false;
+		else if (strcmp(argv[i], "--serial") == 0) pipelineFlag = false;
+		else if (strcmp(argv[i], "--timing") == 0) timingFlag = true;
+		else if (strcmp(argv[i], "--timing-log") == 0 && i + 1 < argc) {
+			timingFlag = true;
+			timingLogPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--diagnostics") == 0 && i + 1 < argc) diagnosticsInterval = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--diagnostics-tolerance") == 0 && i + 1 < argc) diagnosticsTolerance = atof(argv[++i]);
+		else if (strcmp(argv[i], "--no-shader-cache") == 0) shaderCacheFlag = false;
+		else if (strcmp(argv[i], "--rotors") == 0 && i + 1 < argc) rotorCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warp") == 0 && i + 1 < argc) timeWarp = atof(argv[++i]);
+		else if (strcmp(argv[i], "--substep") == 0 && i + 1 < argc) substep = atof(argv[++i]);
+		else if (strcmp(argv[i], "--step-budget") == 0 && i + 1 < argc) stepBudget = atof(argv[++i]) / 1000.0;
+		else if (strcmp(argv[i], "--density") == 0) densityFlag = true;
+		else if (strcmp(argv[i], "--split") == 0) splitFlag = true;
+		else if (strcmp(argv[i], "--trails") == 0 && i + 1 < argc) trailLength = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) historyKeyframes = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--keyframe-interval") == 0 && i + 1 < argc) keyframeInterval = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--sleep") == 0 && i + 6 < argc) {
+			sleepFlag = true;
+			for (int k = 0; k < 3; k++) sleepRegion.low[k] = (float)atof(argv[++i]);
+			for (int k = 0; k < 3; k++) sleepRegion.high[k] = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--sleep-speed") == 0 && i + 1 < argc) sleepRegion.restSpeed = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--fluid") == 0) fluidFlag = true;
+		else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) streamName = argv[++i];
+		else if (strcmp(argv[i], "--stream-slots") == 0 && i + 1 < argc) streamSlots = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPath = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPath = argv[++i];
+		else if (strcmp(argv[i], "--camera-path") == 0 && i + 1 < argc) cameraPathPath = argv[++i];
+		else if (strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc) targetFrameRate = atof(argv[++i]);
+		else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) multisampleCount = atoi(argv[++i]);
+		else fprintf(stderr, "Unknown option %s\n", argv[i]);
+	}
+	if (fluidFlag && (gpuSimulationFlag || rotorCount != 1)) {
+		fprintf(stderr, "The fluid is simulated on the CPU, in a single rotor\n");
+		gpuSimulationFlag = false;
+		rotorCount = 1;
+	}
+	setShaderCacheEnabled(shaderCacheFlag);
+
 	// Initialise GLFW
 	if (!glfwInit())
 	{
@@ -97,11 +197,12 @@ int main(void)
 		return -1;
 	}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
+	glfwWindowHint(GLFW_SAMPLES, multisampleCount);
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, validateGpuFlag ? GL_FALSE : GL_TRUE);
 
 	// Open a window and create its OpenGL context
 	window = glfwCreateWindow(1024, 768, "Gravity", NULL, NULL);
@@ -122,6 +223,20 @@ int main(void)
 		return -1;
 	}
 
+	if (validateGpuFlag) {
+		// Runs headless too, e.g. LIBGL_ALWAYS_SOFTWARE=1 xvfb-run ./Centrifuge --validate-gpu on Mesa llvmpipe
+		GLuint VertexArrayID;
+		glGenVertexArrays(1, &VertexArrayID);
+		glBindVertexArray(VertexArrayID);
+
+		initParticles(getCentrifugeRadius(), getCentrifugeAngle());
+		bool passed = validateGpuSimulation(2000, 1.0f / 60.0f * timeRatio, 1e-3f);
+
+		glDeleteVertexArrays(1, &VertexArrayID);
+		glfwTerminate();
+		return passed ? 0 : 1;
+	}
+
 	// Ensure we can capture the key being pressed below
 	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 	glfwSetInputMode(window, GLFW_STICKY_MOUSE_BUTTONS, GL_TRUE);
@@ -143,6 +258,8 @@ int main(void)
 	glGenVertexArrays(1, &VertexArrayID);
 	glBindVertexArray(VertexArrayID);
 
+	// The texture is read on a worker thread while the shaders compile and the particles are initialized
+	int particleTexture = requestTexture("particle.DDS");
 
 	// Create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders("Particle.vertexshader", "Particle.fragmentshader");
@@ -154,11 +271,31 @@ int main(void)
 
 	// fragment shader
 	GLuint TextureID = glGetUniformLocation(programID, "myTextureSampler");
-	GLuint Texture = loadDDS("particle.DDS");
 
+	// Instance formats
+	GLuint InstanceFormatID = glGetUniformLocation(programID, "instanceFormat");
+	GLuint PackedOriginID = glGetUniformLocation(programID, "packedOrigin");
+	GLuint PackedScaleID = glGetUniformLocation(programID, "packedScale");
+	GLuint AttributeSamplerID = glGetUniformLocation(programID, "attributeSampler");
+	GLuint CameraPosition_worldspace_ID = glGetUniformLocation(programID, "CameraPosition_worldspace");
+	GLuint LodDistanceID = glGetUniformLocation(programID, "lodDistance");
+	GLuint SubsampleID = glGetUniformLocation(programID, "subsample");
+	GLuint ReorderedID = glGetUniformLocation(programID, "reordered");
+	GLuint InstanceSamplerID = glGetUniformLocation(programID, "instanceSampler");
+	if (gpuSimulationFlag) {
+		packedFlag = false; // Nothing is uploaded in this mode
+		pipelineFlag = false; // The step is a GL call
+		rotorCount = 1; // The shader only knows one rotor
+		historyKeyframes = 0; // The particles live in GPU buffers
+		densityFlag = false; // The grid is binned from the CPU particles
+		trailLength = 0; // Same for the trail samples
+		streamName = NULL; // And the published particles
+	}
 
-	static GLfloat* g_particule_position_size_data = new GLfloat[MaxParticles * 4];
-	static GLubyte* g_particule_color_data = new GLubyte[MaxParticles * 4];
+	// One indirect command per group. Without GL 4.3, the groups are contiguous, so one instanced draw covers them all.
+	bool multiDrawFlag = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+	GLuint indirect_buffer = 0;
+	if (multiDrawFlag) glGenBuffers(1, &indirect_buffer);
 
 	// The VBO containing the 4 vertices of the particles.
 	// Thanks to instancing, they will be shared by all particles.
@@ -173,19 +310,28 @@ int main(void)
 	glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
 
-	// The VBO containing the positions and sizes of the particles
-	GLuint particles_position_buffer;
-	glGenBuffers(1, &particles_position_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
+	// The VBO containing the positions and IDs of the particles (or their packed version), the only data sent each frame
+	GLuint particles_instance_buffer;
+	glGenBuffers(1, &particles_instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
 	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, MaxParticles * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW);
 
-	// The VBO containing the colors of the particles
+	// The VBO containing the colors of the particles, only used by the GPU simulation
 	GLuint particles_color_buffer;
 	glGenBuffers(1, &particles_color_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-	// Initialize with empty (NULL) buffer : it will be updated later, each frame.
-	glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW);
+
+	// The attribute table : static colors and sizes, indexed by particle ID (or by palette index when packed)
+	GLuint attribute_buffer, AttributeTexture;
+	glGenBuffers(1, &attribute_buffer);
+	glGenTextures(1, &AttributeTexture);
+
+	// Split view : the rotor view reads the instance buffer through a texture, in the order of a small index buffer
+	GLuint view_order_buffer, InstanceTexture;
+	glGenBuffers(1, &view_order_buffer);
+	glGenTextures(1, &InstanceTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, InstanceTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, packedFlag ? GL_RG32UI : GL_RGBA32UI, particles_instance_buffer); // Follows the orphaning of the buffer
 
 
 	// Create and compile our GLSL program from the shaders
@@ -201,131 +347,135 @@ int main(void)
 	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer2);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data2), g_vertex_buffer_data2, GL_STATIC_DRAW);
 
-	float radius = getCentrifugeRadius();
-	float angle = getCentrifugeAngle();
+	initScene(rotorCount);
+	if (fluidFlag) {
+		const CentrifugeGroup& group = getGroup(0); // shortcut
+		initFluid(ParticlesContainer + group.first, group.count - 1, defaultFluidParameters, group.center, group.radius, group.speed, group.angle);
+	}
+	else if (sleepFlag && !gpuSimulationFlag) initSleep(sleepRegion); // The GPU steps every slot
+	initHistory(historyKeyframes, keyframeInterval);
+	initTrails(trailLength);
+	if (streamName != NULL) initStream(streamName, MaxParticles, streamSlots); // Runs without it if the segment cannot be created
+	if (isTrailsEnabled() && !initTrailRenderer()) {
+		getchar();
+		glfwTerminate();
+		return -1;
+	}
+
+	if (!gpuSimulationFlag && !initDensityRenderer()) {
+		getchar();
+		glfwTerminate();
+		return -1;
+	}
 
-	for (int i = 0; i < MaxParticles - 1; i++) {
-		int particleIndex = i;
-		
-		ParticlesContainer[particleIndex].pos = glm::vec3(radius*sin(angle), radius*cos(angle), 0);
+	if (!gpuSimulationFlag) {
+		std::vector<glm::vec4> attributes(2 * MaxParticles);
+		int attributeCount = MaxParticles;
+		if (packedFlag) {
+			attributeCount = buildParticlePalette(ParticlesContainer, MaxParticles, &attributes[0]);
+			printf("Packed instances : %d palette entries\n", attributeCount);
+		} else {
+			buildAttributeTable(ParticlesContainer, MaxParticles, &attributes[0]);
+		}
 
-		// Generate a random color
-		ParticlesContainer[particleIndex].r = rand() % 256;
-		ParticlesContainer[particleIndex].g = rand() % 256;
-		ParticlesContainer[particleIndex].b = rand() % 256;
-		ParticlesContainer[particleIndex].a = rand() % 256;
+		glBindBuffer(GL_TEXTURE_BUFFER, attribute_buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 2 * attributeCount * sizeof(glm::vec4), &attributes[0], GL_STATIC_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, AttributeTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, attribute_buffer);
+	}
 
-		ParticlesContainer[particleIndex].size = (rand() % 1000) / 2000.0f + 0.1f;
-		ParticlesContainer[particleIndex].size = 0.2f;
-		ParticlesContainer[particleIndex].life = 1000.0f; // This particle will live 5 seconds.
+	if (gpuSimulationFlag) {
+		if (!initGpuSimulation(ParticlesContainer, BoomKicks, MaxParticles)) {
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
 
+		// The particles never move in the buffer, so the colors are uploaded once
+		std::vector<GLubyte> colors(MaxParticles * 4);
+		for (int i = 0; i < MaxParticles; i++) {
+			colors[4 * i + 0] = ParticlesContainer[i].r;
+			colors[4 * i + 1] = ParticlesContainer[i].g;
+			colors[4 * i + 2] = ParticlesContainer[i].b;
+			colors[4 * i + 3] = ParticlesContainer[i].a;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
+		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), &colors[0], GL_STATIC_DRAW);
 	}
 
-	ParticlesContainer[MaxParticles - 1].pos = glm::vec3(0, 0, 0);
-	ParticlesContainer[MaxParticles - 1].speed = glm::vec3(0, 0, 0);
-	ParticlesContainer[MaxParticles - 1].r = 255;
-	ParticlesContainer[MaxParticles - 1].g = 255;
-	ParticlesContainer[MaxParticles - 1].b = 255;
-	ParticlesContainer[MaxParticles - 1].a = 255;
-	ParticlesContainer[MaxParticles - 1].size = 0.2f;
-	ParticlesContainer[MaxParticles - 1].life = 1000.0f;
 
+	FrameOptions frameOptions;
+	frameOptions.gpuSimulation = gpuSimulationFlag;
+	frameOptions.packed = packedFlag;
+	frameOptions.cull = cullFlag;
+	frameOptions.density = densityFlag;
+	frameOptions.split = splitFlag;
+	frameOptions.diagnosticsInterval = diagnosticsInterval;
+	frameOptions.diagnosticsTolerance = diagnosticsTolerance;
+	frameOptions.timeWarp = timeWarp;
+	frameOptions.substep = substep > 0.0 ? substep : 1.0 / 60.0 * timeRatio;
+	frameOptions.stepBudget = stepBudget;
+	// Before the first frame : the scripts start with it
+	if (recordPath != NULL) {
+		// The replay needs the same options : they are kept in the recording
+		std::string commandLine;
+		for (int i = 0; i < argc; i++) commandLine += std::string(i > 0 ? " " : "") + argv[i];
+		initInputRecording(recordPath, commandLine.c_str());
+	}
+	if (replayPath != NULL && !initInputReplay(replayPath)) {
+		getchar();
+		glfwTerminate();
+		return -1;
+	}
+	if (cameraPathPath != NULL && !loadCameraPath(cameraPathPath)) {
+		getchar();
+		glfwTerminate();
+		return -1;
+	}
+	initFrames(frameOptions, glfwGetTime());
+	if (timingFlag) initFrameTiming(timingLogPath, 300);
+	if (targetFrameRate > 0.0) {
+		initGovernor(targetFrameRate);
+		glfwSwapInterval(0); // A synchronized frame never looks faster than the refresh rate, the quality would not come back
+	}
+	double lastSwapTime = getTimerSeconds();
+	if (pipelineFlag) startSimulationThread(glfwGetTime());
 
-	double lastTime = glfwGetTime();
-	bool boomFlag = false;
 	do
 	{
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		double currentTime = glfwGetTime();
-		double delta = (currentTime - lastTime) * timeRatio;
-		lastTime = currentTime;
-
-
-		computeMatricesFromInputs();
-		glm::mat4 ProjectionMatrix = getProjectionMatrix();
-		glm::mat4 ViewMatrix = getViewMatrix();
-
-		// We will need the camera's position in order to sort the particles
-		// w.r.t the camera's distance.
-		// There should be a getCameraPosition() function in common/controls.cpp, 
-		// but this works too.
-		glm::vec3 CameraPosition(getCameraPosition());
-
-		glm::mat4 ViewProjectionMatrix = ProjectionMatrix * ViewMatrix;
-
-		// Simulate all particles
-		int ParticlesCount = 0;
-		angle += centrifugeSpeed * (float)delta;
-		setCentrifugeAngle(angle);
-		if (!boomFlag && startFlag) {
-			for (int i = 0; i < MaxParticles; i++) {
-				Particle& p = ParticlesContainer[i]; // shortcut
-
-				float speed = boomSpeed * pow((rand() % 10000) / 10000.0f, 0.3);
-				float longitude = 2.0f * 3.1416f * (rand() % 10000) / 10000.0f;
-				float latitude = acos((rand() % 20000 - 10000.0f) / 10000.0f);
-
-				glm::vec3 randomdir = glm::vec3(
-					speed * sin(longitude) * sin(latitude),
-					speed * cos(longitude) * sin(latitude),
-					speed * cos(latitude)
-				);
 
-				p.speed += randomdir;
-			}
-			boomFlag = true;
+		// Textures that finished loading since the last frame
+		updateTextures();
+
+		// GLFW input can only be read here, the simulation gets the cursor through the command queue
+		double xpos, ypos;
+		glfwGetCursorPos(window, &xpos, &ypos);
+		pushCommand(CommandCursor, xpos, ypos);
+
+		// Pipelined : take the frame simulated during the previous draw, and start the next one right away
+		const RenderFrame* frame;
+		if (pipelineFlag) {
+			double waitStart = getTimerSeconds();
+			frame = &waitForFrame();
+			addPhaseTime(PhaseWait, getTimerSeconds() - waitStart);
+			requestFrame(currentTime);
+		} else {
+			frame = &simulateSerialFrame(currentTime);
 		}
-		for (int i = 0; i < MaxParticles; i++) {
-			Particle& p = ParticlesContainer[i]; // shortcut
-			if (p.life > 0.0f) {
-				p.life -= delta;
-				if (p.life > 0.0f) {
-
-					if (i != MaxParticles - 1) {
-						if (!startFlag) {
-							p.speed = centrifugeSpeed * radius * glm::vec3(cos(angle), -sin(angle), 0);
-							p.pos = glm::vec3(radius*sin(angle), radius*cos(angle), 0);
-							p.cameradistance = glm::length2(p.pos - CameraPosition);
-						} else {
-							glm::vec3 startSpeed = p.speed;
-							glm::vec3 boxSpeed = centrifugeSpeed * radius * glm::vec3(cos(angle), -sin(angle), 0);
-							glm::vec3 relativeSpeed = startSpeed - boxSpeed;
-							float relativeSpeedValue = sqrt(relativeSpeed[0] * relativeSpeed[0] + relativeSpeed[1] * relativeSpeed[1] + relativeSpeed[2] * relativeSpeed[2]);
-							glm::vec3 gravity = glm::vec3(0.0f, 0.0f, -gravityAcceleraion); // Gravity acceleration
-							glm::vec3 friction = (float)(frictionCoefficient * relativeSpeedValue / p.size) * startSpeed; // Friction acceleration, f=kSv^2, where we set k=0.01
-							glm::vec3 endSpeed = startSpeed + (float)delta * (gravity + friction);
-							glm::vec3 aveSpeed = (startSpeed + endSpeed) * 0.5f;
-							p.speed = endSpeed;
-							p.pos += p.speed * (float)delta;
-							p.cameradistance = glm::length2(p.pos - CameraPosition);
-						}
-					}
-
-					// Fill the GPU buffer
-					g_particule_position_size_data[4 * ParticlesCount + 0] = p.pos.x;
-					g_particule_position_size_data[4 * ParticlesCount + 1] = p.pos.y;
-					g_particule_position_size_data[4 * ParticlesCount + 2] = p.pos.z;
-					g_particule_position_size_data[4 * ParticlesCount + 3] = p.size;
-
-					g_particule_color_data[4 * ParticlesCount + 0] = p.r;
-					g_particule_color_data[4 * ParticlesCount + 1] = p.g;
-					g_particule_color_data[4 * ParticlesCount + 2] = p.b;
-					g_particule_color_data[4 * ParticlesCount + 3] = p.a;
-
-				}
-				else {
-					// Particles that just died will be put at the end of the buffer in SortParticles();
-					p.cameradistance = -1.0f;
-				}
-
-				ParticlesCount++;
-
-			}
+		// The simulation phases were measured wherever the frame was simulated
+		addPhaseTime(PhaseSimulate, frame->simulateTime);
+		if (!gpuSimulationFlag) {
+			addPhaseTime(PhaseSort, frame->sortTime);
+			addPhaseTime(PhaseFill, frame->fillTime);
 		}
-
-		SortParticles();
+		int ParticlesCount = frame->count;
+		glm::mat4 ViewMatrix = frame->ViewMatrix;
+		glm::mat4 ViewProjectionMatrix = frame->ViewProjectionMatrix;
+		glm::vec3 CameraPosition = frame->CameraPosition;
 
 
 		//printf("%d ",ParticlesCount);
@@ -336,130 +486,273 @@ int main(void)
 		// but this is outside the scope of this tutorial.
 		// http://www.opengl.org/wiki/Buffer_Object_Streaming
 
-		
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLfloat) * 4, g_particule_position_size_data);
+		double uploadStart = getTimerSeconds();
+		if (!gpuSimulationFlag) beginGpuPhase(PhaseGpuUpload);
+		if (packedFlag) {
+			glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
+			glBufferData(GL_ARRAY_BUFFER, MaxParticles * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+			glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(PackedInstance), frame->packed);
+		} else if (!gpuSimulationFlag) {
+			glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
+			glBufferData(GL_ARRAY_BUFFER, MaxParticles * sizeof(ParticleInstance), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
+			glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(ParticleInstance), frame->instances);
+		}
+		if (frame->split && !gpuSimulationFlag) {
+			// The second view costs 4 bytes per instance, not a second copy of the instances
+			glBindBuffer(GL_ARRAY_BUFFER, view_order_buffer);
+			glBufferData(GL_ARRAY_BUFFER, MaxParticles * sizeof(unsigned int), NULL, GL_STREAM_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(unsigned int), frame->rotorOrder);
+		}
+		// Newest trail sample only, the rest of the ring is already on the GPU
+		if (frame->trailSlot >= 0) uploadTrails(frame->trailSlot, frame->trailSample);
+		endGpuPhase();
+		double drawStart = getTimerSeconds();
+		if (!gpuSimulationFlag) addPhaseTime(PhaseUpload, drawStart - uploadStart);
 
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-		glBufferData(GL_ARRAY_BUFFER, MaxParticles * 4 * sizeof(GLubyte), NULL, GL_STREAM_DRAW); // Buffer orphaning, a common way to improve streaming perf. See above link for details.
-		glBufferSubData(GL_ARRAY_BUFFER, 0, ParticlesCount * sizeof(GLubyte) * 4, g_particule_color_data);
-
-
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-
-		// Use our shader
-		glUseProgram(programID);
-
-		// Bind our texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, Texture);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureID, 0);
-
-		// Same as the billboards tutorial
-		glUniform3f(CameraRight_worldspace_ID, ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0]);
-		glUniform3f(CameraUp_worldspace_ID, ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1]);
-
-		glUniformMatrix4fv(ViewProjMatrixID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
-		glVertexAttribPointer(
-			0,                  // attribute. No particular reason for 0, but must match the layout in the shader.
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// 2nd attribute buffer : positions of particles' centers
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_position_buffer);
-		glVertexAttribPointer(
-			1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-			4,                                // size : x + y + z + size => 4
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// 3rd attribute buffer : particles' colors
-		glEnableVertexAttribArray(2);
-		glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
-		glVertexAttribPointer(
-			2,                                // attribute. No particular reason for 1, but must match the layout in the shader.
-			4,                                // size : r + g + b + a => 4
-			GL_UNSIGNED_BYTE,                 // type
-			GL_TRUE,                          // normalized?    *** YES, this means that the unsigned char[4] will be accessible with a vec4 (floats) in the shader ***
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-
-		// These functions are specific to glDrawArrays*Instanced*.
-		// The first parameter is the attribute buffer we're talking about.
-		// The second parameter is the "rate at which generic vertex attributes advance when rendering multiple instances"
-		// http://www.opengl.org/sdk/docs/man/xhtml/glVertexAttribDivisor.xml
-		glVertexAttribDivisor(0, 0); // particles vertices : always reuse the same 4 vertices -> 0
-		glVertexAttribDivisor(1, 1); // positions : one per quad (its center)                 -> 1
-		glVertexAttribDivisor(2, 1); // color : one per quad                                  -> 1
-
-									 // Draw the particules !
-									 // This draws many times a small triangle_strip (which looks like a quad).
-									 // This is equivalent to :
-									 // for(i in ParticlesCount) : glDrawArrays(GL_TRIANGLE_STRIP, 0, 4), 
-									 // but faster.
-		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ParticlesCount);
-
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
-		glDisableVertexAttribArray(2);
-
-
-		glUseProgram(programID2);
-		glUniformMatrix4fv(MatrixID2, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(9);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer2);
-		glVertexAttribPointer(
-			9,                  // attribute. No particular reason for 0, but must match the layout in the shader.
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// Draw the line !
-		glDisable(GL_BLEND);
-		//glDisable(GL_LINE_SMOOTH);
-		glLineWidth(3.0f);
-		glDrawArrays(GL_LINES, 0, 6); // 2*3 indices starting at 0 -> 2 triangles
-
-		glDisableVertexAttribArray(9);
+
+		// Window state, not frame state : it follows the governor right away
+		if (isGovernorEnabled()) {
+			if (getRenderQuality().multisample) glEnable(GL_MULTISAMPLE);
+			else glDisable(GL_MULTISAMPLE);
+		}
+		beginGpuPhase(PhaseGpuDraw);
+		// Split view : the same instances drawn twice, the lab view on the left half of the window, the rotor view on the right half
+		int width, height;
+		glfwGetFramebufferSize(window, &width, &height);
+		int viewCount = frame->split ? 2 : 1;
+		for (int view = 0; view < viewCount; view++) {
+			bool rotorView = view == 1;
+			bool reordered = rotorView && !gpuSimulationFlag; // The GPU simulation draws its buffer as it is, unsorted
+			if (frame->split) glViewport(view * width / 2, 0, width / 2, height);
+			if (rotorView) {
+				ViewMatrix = frame->RotorViewMatrix;
+				ViewProjectionMatrix = frame->RotorViewProjectionMatrix;
+				CameraPosition = frame->RotorCameraPosition;
+			}
+
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+			// Use our shader
+			glUseProgram(programID);
+
+			// Bind our texture in Texture Unit 0
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, getTexture(particleTexture));
+			// Set our "myTextureSampler" sampler to use Texture Unit 0
+			glUniform1i(TextureID, 0);
+
+			// The attribute table sits in Texture Unit 1, even when unused, so that the two samplers never share a unit
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_BUFFER, AttributeTexture);
+			glUniform1i(AttributeSamplerID, 1);
+			glUniform1i(InstanceFormatID, gpuSimulationFlag ? 0 : packedFlag ? 2 : 1);
+			glUniform3fv(CameraPosition_worldspace_ID, 1, &CameraPosition[0]);
+			glUniform1f(LodDistanceID, frame->culled ? lodDistance : 0.0f);
+			glUniform1f(SubsampleID, frame->subsample);
+			// Same for the instance texture, in Texture Unit 2
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_BUFFER, InstanceTexture);
+			glUniform1i(InstanceSamplerID, 2);
+			glUniform1i(ReorderedID, reordered ? 1 : 0);
+			if (packedFlag) {
+				glUniform3fv(PackedOriginID, 1, &frame->packedOrigin[0]);
+				glUniform3fv(PackedScaleID, 1, &frame->packedScale[0]);
+			}
+			glActiveTexture(GL_TEXTURE0);
+
+			// Same as the billboards tutorial
+			glUniform3f(CameraRight_worldspace_ID, ViewMatrix[0][0], ViewMatrix[1][0], ViewMatrix[2][0]);
+			glUniform3f(CameraUp_worldspace_ID, ViewMatrix[0][1], ViewMatrix[1][1], ViewMatrix[2][1]);
+
+			glUniformMatrix4fv(ViewProjMatrixID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
+
+			// 1rst attribute buffer : vertices
+			glEnableVertexAttribArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
+			glVertexAttribPointer(
+				0,                  // attribute. No particular reason for 0, but must match the layout in the shader.
+				3,                  // size
+				GL_FLOAT,           // type
+				GL_FALSE,           // normalized?
+				0,                  // stride
+				(void*)0            // array buffer offset
+			);
+
+			if (gpuSimulationFlag) {
+				// 2nd attribute buffer : positions of particles' centers, straight from the simulation state
+				glEnableVertexAttribArray(1);
+				glBindBuffer(GL_ARRAY_BUFFER, getGpuParticleBuffer());
+				glVertexAttribPointer(
+					1,                                // attribute. No particular reason for 1, but must match the layout in the shader.
+					4,                                // size : x + y + z + size => 4
+					GL_FLOAT,                         // type
+					GL_FALSE,                         // normalized?
+					sizeof(GpuParticle),              // stride : the GPU state interleaves position+size with speed+life
+					(void*)0                          // array buffer offset
+				);
+
+				// 3rd attribute buffer : particles' colors
+				glEnableVertexAttribArray(2);
+				glBindBuffer(GL_ARRAY_BUFFER, particles_color_buffer);
+				glVertexAttribPointer(
+					2,                                // attribute. No particular reason for 1, but must match the layout in the shader.
+					4,                                // size : r + g + b + a => 4
+					GL_UNSIGNED_BYTE,                 // type
+					GL_TRUE,                          // normalized?    *** YES, this means that the unsigned char[4] will be accessible with a vec4 (floats) in the shader ***
+					0,                                // stride
+					(void*)0                          // array buffer offset
+				);
+			} else {
+				// 2nd attribute buffer : positions of particles' centers
+				glEnableVertexAttribArray(3);
+				glBindBuffer(GL_ARRAY_BUFFER, particles_instance_buffer);
+				glVertexAttribPointer(
+					3,                                // attribute. Must match the layout in the shader.
+					3,                                // size : x + y + z => 3
+					packedFlag ? GL_SHORT : GL_FLOAT, // type
+					packedFlag ? GL_TRUE : GL_FALSE,  // normalized?    *** packed : the shader sees [-1, 1] and applies origin/scale ***
+					packedFlag ? sizeof(PackedInstance) : sizeof(ParticleInstance), // stride
+					(void*)0                          // array buffer offset
+				);
+
+				// 3rd attribute buffer : particle ID or palette index, read as an integer
+				glEnableVertexAttribArray(4);
+				glVertexAttribIPointer(
+					4,                                // attribute. Must match the layout in the shader.
+					1,                                // size : index => 1
+					packedFlag ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, // type
+					packedFlag ? sizeof(PackedInstance) : sizeof(ParticleInstance), // stride
+					(void*)(packedFlag ? 3 * sizeof(short) : 3 * sizeof(float)) // array buffer offset
+				);
+
+				if (reordered) {
+					// 4th attribute buffer : the instance to draw, back to front for this view
+					glEnableVertexAttribArray(5);
+					glBindBuffer(GL_ARRAY_BUFFER, view_order_buffer);
+					glVertexAttribIPointer(
+						5,                                // attribute. Must match the layout in the shader.
+						1,                                // size : index => 1
+						GL_UNSIGNED_INT,                  // type
+						0,                                // stride
+						(void*)0                          // array buffer offset
+					);
+				}
+			}
+
+			// These functions are specific to glDrawArrays*Instanced*.
+			// The first parameter is the attribute buffer we're talking about.
+			// The second parameter is the "rate at which generic vertex attributes advance when rendering multiple instances"
+			// http://www.opengl.org/sdk/docs/man/xhtml/glVertexAttribDivisor.xml
+			glVertexAttribDivisor(0, 0); // particles vertices : always reuse the same 4 vertices -> 0
+			glVertexAttribDivisor(1, 1); // positions : one per quad (its center)                 -> 1
+			glVertexAttribDivisor(2, 1); // color : one per quad                                  -> 1
+			glVertexAttribDivisor(3, 1); // positions : one per quad (its center)                 -> 1
+			glVertexAttribDivisor(4, 1); // attribute index : one per quad                        -> 1
+			glVertexAttribDivisor(5, 1); // instance order : one per quad                         -> 1
+
+										 // Draw the particules !
+										 // This draws many times a small triangle_strip (which looks like a quad).
+										 // This is equivalent to :
+										 // for(i in ParticlesCount) : glDrawArrays(GL_TRIANGLE_STRIP, 0, 4), 
+										 // but faster.
+			if (reordered) {
+				// Sorted across the groups, so one draw of all the instances
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ParticlesCount);
+			} else if (multiDrawFlag && !gpuSimulationFlag) {
+				// All the groups in one call, baseInstance selects the instance range of each group
+				DrawArraysIndirectCommand commands[MaxGroups];
+				for (int k = 0; k < frame->groups; k++) {
+					commands[k].count = 4;
+					commands[k].instanceCount = frame->groupCount[k];
+					commands[k].first = 0;
+					commands[k].baseInstance = frame->groupFirst[k];
+				}
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirect_buffer);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, frame->groups * sizeof(DrawArraysIndirectCommand), commands, GL_STREAM_DRAW);
+				glMultiDrawArraysIndirect(GL_TRIANGLE_STRIP, (void*)0, frame->groups, 0);
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+			} else {
+				glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ParticlesCount);
+			}
+
+			glDisableVertexAttribArray(0);
+			glDisableVertexAttribArray(1);
+			glDisableVertexAttribArray(2);
+			glDisableVertexAttribArray(3);
+			glDisableVertexAttribArray(4);
+			glDisableVertexAttribArray(5);
+
+			// Density view : the billboard pass above had no instance
+			if (frame->densityView) drawDensity(frame->density, frame->densityMax);
+			else if (frame->trailSamples > 1) drawTrails(ViewProjectionMatrix, frame->trailHead, frame->trailSamples, frame->trailAges, frame->rotating || rotorView);
+
+
+			glUseProgram(programID2);
+			glUniformMatrix4fv(MatrixID2, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
+
+			// 1rst attribute buffer : vertices
+			glEnableVertexAttribArray(9);
+			glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer2);
+			glVertexAttribPointer(
+				9,                  // attribute. No particular reason for 0, but must match the layout in the shader.
+				3,                  // size
+				GL_FLOAT,           // type
+				GL_FALSE,           // normalized?
+				0,                  // stride
+				(void*)0            // array buffer offset
+			);
+
+			// Draw the line !
+			glDisable(GL_BLEND);
+			//glDisable(GL_LINE_SMOOTH);
+			glLineWidth(3.0f);
+			glDrawArrays(GL_LINES, 0, 6); // 2*3 indices starting at 0 -> 2 triangles
+
+			glDisableVertexAttribArray(9);
+		}
+		if (frame->split) glViewport(0, 0, width, height);
+		endGpuPhase();
+		double swapStart = getTimerSeconds();
+		addPhaseTime(PhaseDraw, swapStart - drawStart);
 
 		// Swap buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
+		double swapEnd = getTimerSeconds();
+		addPhaseTime(PhaseSwap, swapEnd - swapStart);
+		endFrameTiming();
+		updateGovernor(swapEnd - lastSwapTime);
+		lastSwapTime = swapEnd;
 
-	} // Check if the ESC key was pressed or the window was closed
+	} // Check if the ESC key was pressed, the window was closed or the script is over
 	while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-		glfwWindowShouldClose(window) == 0);
+		glfwWindowShouldClose(window) == 0 && !isScriptFinished());
+
 
+	if (pipelineFlag) stopSimulationThread();
+	cleanupFrames();
+	cleanupHistory();
+	cleanupTrails();
+	cleanupFluid();
+	cleanupStream();
+	cleanupReplay();
+	cleanupFrameTiming();
 
-	delete[] g_particule_position_size_data;
+	if (gpuSimulationFlag) cleanupGpuSimulation();
+	else cleanupDensityRenderer();
 
 	// Cleanup VBO and shader
 	glDeleteBuffers(1, &particles_color_buffer);
-	glDeleteBuffers(1, &particles_position_buffer);
+	glDeleteBuffers(1, &particles_instance_buffer);
+	if (indirect_buffer != 0) glDeleteBuffers(1, &indirect_buffer);
+	glDeleteBuffers(1, &attribute_buffer);
+	glDeleteTextures(1, &AttributeTexture);
+	glDeleteBuffers(1, &view_order_buffer);
+	glDeleteTextures(1, &InstanceTexture);
 	glDeleteBuffers(1, &billboard_vertex_buffer);
 	glDeleteProgram(programID);
-	glDeleteTextures(1, &Texture);
+	cleanupTextures();
 	glDeleteVertexArrays(1, &VertexArrayID);
 
 
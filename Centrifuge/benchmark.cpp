@@ -0,0 +1,544 @@
+// Microbenchmarks of the hot paths, built by Benchmark.vcxproj.
+//
+// Benchmark [--counts 5000,50000,...] [--threads 1,2,4,...] [--repeat 5] [--output results.csv]
+//           [--baseline baseline.csv] [--tolerance 0.1] [--no-gl]
+//
+// Every case is run --repeat times and reported as median and minimum, in milliseconds.
+// The cases of the program itself (scene_step, scene_sort) work on its container, at MaxParticles whatever --counts.
+// With --baseline, each result is compared to the row with the same name, count and threads,
+// and the exit code is 1 if one of them is slower than the baseline by more than the tolerance.
+// The spatial queries are also checked against a brute force search, the exit code is 1 if they differ.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+#include <GL/glew.h>
+
+#include <glfw3.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include "shader.hpp"
+#include "texture.hpp"
+#include "simulation.hpp"
+#include "forces.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "culling.hpp"
+#include "packing.hpp"
+#include "timing.hpp"
+#include "diagnostics.hpp"
+#include "spatial.hpp"
+#include "fluid.hpp"
+#include "stream.hpp"
+
+struct BenchmarkResult {
+	std::string name;
+	int count; // Particles, 0 for the loaders
+	int threads;
+	double median, min; // Milliseconds
+};
+
+static std::vector<BenchmarkResult> results;
+static int spatialMismatches = 0;
+
+GLFWwindow* window = NULL; // Of the program, read by controls.cpp, which the scene takes its rotor from
+
+// Run body() repeat times, setup() before each run is not measured
+static void measure(const char* name, int count, int threads, int repeat, const std::function<void()>& setup, const std::function<void()>& body) {
+	std::vector<double> times;
+	for (int r = 0; r < repeat; r++) {
+		if (setup) setup();
+		double start = getTimerSeconds();
+		body();
+		times.push_back(1000.0 * (getTimerSeconds() - start));
+	}
+	std::sort(times.begin(), times.end());
+
+	BenchmarkResult result;
+	result.name = name;
+	result.count = count;
+	result.threads = threads;
+	result.median = times[times.size() / 2];
+	result.min = times[0];
+	results.push_back(result);
+
+	if (count > 0) {
+		printf("%-20s %10d particles %3d threads : %10.3f ms (min %10.3f ms, %8.2f Mparticles/s)\n",
+			name, count, threads, result.median, result.min, count / (1000.0 * result.median));
+	} else {
+		printf("%-20s %32s : %10.3f ms (min %10.3f ms)\n", name, "", result.median, result.min);
+	}
+}
+
+// Comma separated list of integers
+static std::vector<int> parseList(const char* text) {
+	std::vector<int> values;
+	const char* p = text;
+	while (*p) {
+		values.push_back(atoi(p));
+		p = strchr(p, ',');
+		if (p == NULL) break;
+		p++;
+	}
+	return values;
+}
+
+// Copy of the particles in another precision policy, see simulation.hpp
+template <typename Precision>
+static std::vector<BasicParticle<Precision> > convertParticles(const std::vector<Particle>& particles) {
+	std::vector<BasicParticle<Precision> > converted(particles.size());
+	for (size_t i = 0; i < particles.size(); i++) {
+		BasicParticle<Precision>& c = converted[i]; // shortcut
+		const Particle& p = particles[i]; // shortcut
+		c.pos = p.pos;
+		c.speed = p.speed;
+		c.r = p.r; c.g = p.g; c.b = p.b; c.a = p.a;
+		c.size = p.size;
+		c.angle = p.angle;
+		c.weight = p.weight;
+		c.life = p.life;
+		c.cameradistance = p.cameradistance;
+		c.palette = p.palette;
+		c.asleep = p.asleep;
+		c.id = p.id;
+	}
+	return converted;
+}
+
+// simulateParticles() with another force model than ActiveForces
+template <typename Forces>
+static void simulateWithForces(std::vector<Particle>& particles, float delta, const RotorStep& rotor, const glm::vec3& CameraPosition) {
+	for (size_t i = 0; i + 1 < particles.size(); i++) {
+		Particle& p = particles[i]; // shortcut
+		if (p.life <= 0.0f) continue;
+		p.life -= delta;
+		integrateParticle<Forces>(p, delta, rotor, true);
+		glm::vec3 d = glm::vec3(p.pos) - CameraPosition;
+		p.cameradistance = glm::dot(d, d);
+	}
+}
+
+// Spatial queries : one radius, one box and the k nearest per center
+struct SpatialQueries {
+	std::vector<glm::vec3> centers, lows, highs;
+	std::vector<float> radii;
+};
+
+// Answers of the spatial queries, from the index or by brute force
+struct SpatialAnswers {
+	std::vector<int> radiusCounts, boxCounts;
+	std::vector<float> distances; // k per query, nearest first
+};
+
+const int SpatialK = 16;
+const int CheckedQueries = 32; // The brute force visits every particle per query
+
+static void addSpatialQuery(SpatialQueries& queries, const glm::vec3& center, float radius, const glm::vec3& low, const glm::vec3& high) {
+	queries.centers.push_back(center);
+	queries.radii.push_back(radius);
+	queries.lows.push_back(low);
+	queries.highs.push_back(high);
+}
+
+// Queries that must not break the grid : beyond the range of the cell coordinates, infinite, NaN
+static void addExtremeQueries(SpatialQueries& queries) {
+	const float nan = NAN;
+	glm::vec3 far(1e20f), nanVector(nan);
+	addSpatialQuery(queries, glm::vec3(0), 1e10f, glm::vec3(-1e10f), glm::vec3(1e10f));
+	addSpatialQuery(queries, glm::vec3(0), 1e30f, glm::vec3(-1e30f), glm::vec3(1e30f));
+	addSpatialQuery(queries, glm::vec3(3e9f, 0, 0), 1.0f, glm::vec3(3e9f - 1, -1, -1), glm::vec3(3e9f + 1, 1, 1));
+	addSpatialQuery(queries, far, 1.0f, far - 1.0f, far + 1.0f);
+	addSpatialQuery(queries, -far, 1e20f, -far, far);
+	addSpatialQuery(queries, glm::vec3(0), INFINITY, glm::vec3(-INFINITY), glm::vec3(INFINITY));
+	addSpatialQuery(queries, nanVector, 1.0f, nanVector, nanVector);
+	addSpatialQuery(queries, glm::vec3(0), nan, glm::vec3(-INFINITY), glm::vec3(INFINITY, nan, INFINITY));
+}
+
+// Same arithmetic as spatial.cpp, so that the answers are equal, not only close
+static SpatialAnswers bruteForceQueries(const std::vector<Particle>& particles, const SpatialQueries& queries) {
+	int queryCount = (int)queries.centers.size();
+	SpatialAnswers answers;
+	answers.radiusCounts.assign(queryCount, 0);
+	answers.boxCounts.assign(queryCount, 0);
+	answers.distances.assign(queryCount * SpatialK, -1.0f);
+	std::vector<float> squared;
+	for (int q = 0; q < queryCount; q++) {
+		const glm::vec3& center = queries.centers[q]; // shortcut
+		float radius2 = queries.radii[q] * queries.radii[q];
+		squared.clear();
+		for (size_t i = 0; i < particles.size(); i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			glm::vec3 pos(p.pos);
+			glm::vec3 d = pos - center;
+			float d2 = glm::dot(d, d);
+			squared.push_back(d2);
+			if (d2 <= radius2) answers.radiusCounts[q]++;
+			if (glm::all(glm::greaterThanEqual(pos, queries.lows[q])) && glm::all(glm::lessThanEqual(pos, queries.highs[q]))) answers.boxCounts[q]++;
+		}
+		// No nearest particles to a NaN or infinite center
+		if (!glm::all(glm::lessThan(glm::abs(center), glm::vec3(INFINITY)))) continue;
+		int found = std::min(SpatialK, (int)squared.size());
+		std::partial_sort(squared.begin(), squared.begin() + found, squared.end());
+		for (int n = 0; n < found; n++) answers.distances[q * SpatialK + n] = sqrt(squared[n]);
+	}
+	return answers;
+}
+
+static SpatialAnswers indexQueries(const SpatialQueries& queries) {
+	int queryCount = (int)queries.centers.size();
+	SpatialAnswers answers;
+	answers.radiusCounts.resize(queryCount);
+	answers.boxCounts.resize(queryCount);
+	answers.distances.resize(queryCount * SpatialK);
+	std::vector<unsigned int> ids(queryCount * SpatialK);
+	countInRadiusBatch(&queries.centers[0], &queries.radii[0], queryCount, &answers.radiusCounts[0]);
+	countInBoxBatch(&queries.lows[0], &queries.highs[0], queryCount, &answers.boxCounts[0]);
+	findNearestBatch(&queries.centers[0], queryCount, SpatialK, &ids[0], &answers.distances[0]);
+	return answers;
+}
+
+// Prints the queries that differ from the brute force
+static void compareSpatialQueries(const SpatialAnswers& index, const SpatialAnswers& reference, int count, int threads) {
+	for (int q = 0; q < (int)reference.radiusCounts.size(); q++) {
+		const char* differs = NULL;
+		if (index.radiusCounts[q] != reference.radiusCounts[q]) differs = "radius count";
+		else if (index.boxCounts[q] != reference.boxCounts[q]) differs = "box count";
+		else if (!std::equal(index.distances.begin() + q * SpatialK, index.distances.begin() + (q + 1) * SpatialK,
+			reference.distances.begin() + q * SpatialK)) differs = "nearest distances";
+		if (differs == NULL) continue;
+		fprintf(stderr, "spatial : %d particles %d threads, query %d : %s differs from the brute force\n", count, threads, q, differs);
+		spatialMismatches++;
+	}
+}
+
+static void benchmarkParticles(int count, const std::vector<int>& threadCounts, int repeat) {
+	const float radius = 5.0f; // Same as controls.cpp
+	const float angle = 0.0f;
+	const float delta = 0.01f;
+
+	std::vector<Particle> particles(count);
+	std::vector<Particle> snapshot(count);
+	std::vector<glm::vec3> kicks(count);
+	std::vector<ParticleInstance> instances(count);
+	std::vector<PackedInstance> packed(count);
+
+	// Default camera of controls.cpp, looking at the centrifuge
+	glm::vec3 CameraPosition(0.0f, -30.0f, 0.0f);
+	glm::mat4 ViewProjectionMatrix = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 1000.0f)
+		* glm::lookAt(CameraPosition, glm::vec3(0, 0, 0), glm::vec3(0, 0, 1));
+	ViewCull cull = makeViewCull(ViewProjectionMatrix, CameraPosition, lodDistance);
+
+	measure("init", count, 1, repeat, NULL, [&] {
+		initParticles(&particles[0], &kicks[0], count, radius, angle);
+	});
+	// Every run booms the particles as they were initialized : the cloud below gets one kick, not repeat of them
+	snapshot = particles;
+	measure("boom", count, 1, repeat, [&] { particles = snapshot; }, [&] {
+		boomParticles(&particles[0], &kicks[0], count);
+	});
+	// Spread the cloud a little, so that the sort and the culling see a realistic scene
+	for (int i = 0; i < 10; i++) {
+		simulateParticles(&particles[0], count, 0.1f, radius, angle, true, CameraPosition);
+	}
+	measure("step", count, 1, repeat, NULL, [&] {
+		simulateParticles(&particles[0], count, delta, radius, angle, true, CameraPosition);
+	});
+	// Gravity and drag, whatever the coefficient : the cost of a term that is compiled in
+	RotorStep rotor = makeRotorStep(glm::vec3(0, 0, 0), radius, centrifugeSpeed, angle);
+	measure("step_drag", count, 1, repeat, NULL, [&] {
+		simulateWithForces<ForceModel<UniformGravity, QuadraticDrag> >(particles, delta, rotor, CameraPosition);
+	});
+	// The other precision policies, whatever the one the program is built with
+	std::vector<BasicParticle<DoublePrecision> > doubleParticles = convertParticles<DoublePrecision>(particles);
+	measure("step_double", count, 1, repeat, NULL, [&] {
+		simulateParticles(&doubleParticles[0], count, (double)delta, radius, angle, true, CameraPosition);
+	});
+	std::vector<BasicParticle<MixedPrecision> > mixedParticles = convertParticles<MixedPrecision>(particles);
+	measure("step_mixed", count, 1, repeat, NULL, [&] {
+		simulateParticles(&mixedParticles[0], count, (double)delta, radius, angle, true, CameraPosition);
+	});
+
+	// The liquid of --fluid, the last particle is the marker. Above a million, one step takes seconds.
+	std::vector<Particle> fluidParticles;
+	if (count <= 1000000) {
+		fluidParticles = particles;
+		initFluid(&fluidParticles[0], count - 1, defaultFluidParameters, glm::vec3(0, 0, 0), radius, centrifugeSpeed, angle);
+	}
+
+	// The spatial queries : 1000 of them centered on particles, the first ones checked against the brute force
+	std::vector<glm::vec3> centers(1000), lows(centers.size()), highs(centers.size());
+	std::vector<float> radii(centers.size());
+	std::vector<int> radiusCounts(centers.size()), boxCounts(centers.size());
+	std::vector<unsigned int> neighbours(SpatialK * centers.size());
+	std::vector<float> neighbourDistances(SpatialK * centers.size());
+	for (size_t q = 0; q < centers.size(); q++) {
+		centers[q] = particles[(q * 7919) % count].pos;
+		radii[q] = 0.5f * (1 + q % 4);
+		lows[q] = centers[q] - glm::vec3(radii[q]);
+		highs[q] = centers[q] + glm::vec3(radii[q]);
+	}
+	SpatialQueries checked;
+	for (int q = 0; q < CheckedQueries; q++) addSpatialQuery(checked, centers[q], radii[q], lows[q], highs[q]);
+	addExtremeQueries(checked);
+	SpatialAnswers reference = bruteForceQueries(particles, checked);
+
+	// The sort always starts from the same unsorted state
+	snapshot = particles;
+	measure("sort", count, 1, repeat, [&] { particles = snapshot; }, [&] {
+		SortParticles(&particles[0], count);
+	});
+
+	for (size_t t = 0; t < threadCounts.size(); t++) {
+		int threads = threadCounts[t];
+		setThreadCount(threads);
+		measure("fill", count, threads, repeat, NULL, [&] {
+			fillInstances(&particles[0], count, &instances[0], NULL);
+		});
+		measure("fill_cull", count, threads, repeat, NULL, [&] {
+			fillInstances(&particles[0], count, &instances[0], &cull);
+		});
+		glm::vec3 origin, scale;
+		measure("pack", count, threads, repeat, NULL, [&] {
+			packParticles(&particles[0], count, &packed[0], origin, scale, NULL);
+		});
+		unsigned int markerId = count - 1;
+		measure("diagnostics", count, threads, repeat, NULL, [&] {
+			computeDiagnostics(&particles[0], count, &markerId, 1);
+		});
+		measure("spatial_build", count, threads, repeat, NULL, [&] {
+			buildSpatialIndex(&particles[0], count);
+		});
+		measure("spatial_knn", count, threads, repeat, NULL, [&] {
+			findNearestBatch(&centers[0], (int)centers.size(), SpatialK, &neighbours[0], &neighbourDistances[0]);
+		});
+		measure("spatial_radius", count, threads, repeat, NULL, [&] {
+			countInRadiusBatch(&centers[0], &radii[0], (int)centers.size(), &radiusCounts[0]);
+		});
+		measure("spatial_box", count, threads, repeat, NULL, [&] {
+			countInBoxBatch(&lows[0], &highs[0], (int)centers.size(), &boxCounts[0]);
+		});
+		// The batches are spread over the threads, each thread count is checked
+		compareSpatialQueries(indexQueries(checked), reference, count, threads);
+		cleanupSpatialIndex();
+		// Into a shared memory segment of this process, nobody reading
+		if (initStream("centrifuge-benchmark", count, 4)) {
+			long long step = 0;
+			measure("stream_publish", count, threads, repeat, NULL, [&] {
+				publishStream(&particles[0], count, step, step * delta, angle);
+				step++;
+			});
+			cleanupStream();
+		}
+		if (!fluidParticles.empty()) {
+			// A single internal step : delta is below the CFL limit
+			measure("fluid_step", count, threads, repeat, NULL, [&] {
+				stepFluid(&fluidParticles[0], count - 1, 1e-6, glm::vec3(0, 0, 0), centrifugeSpeed, angle, true);
+			});
+		}
+	}
+	cleanupFluid();
+	setThreadCount(0);
+}
+
+// The step and the sort of the program, over the active set of the scene : the same parallel passes as a frame
+static void benchmarkScene(const std::vector<int>& threadCounts, int repeat) {
+	const double delta = 0.01;
+	glm::vec3 CameraPosition(0.0f, -30.0f, 0.0f);
+
+	initScene(4);
+	boomParticles();
+	// Spread the cloud, in slot order the particles are then far from sorted
+	for (int i = 0; i < 10; i++) simulateScene(0.1, true);
+	std::vector<Particle> snapshot(ParticlesContainer, ParticlesContainer + MaxParticles);
+	auto restore = [&] {
+		std::copy(snapshot.begin(), snapshot.end(), ParticlesContainer);
+		invalidateActiveSet();
+	};
+
+	for (size_t t = 0; t < threadCounts.size(); t++) {
+		int threads = threadCounts[t];
+		setThreadCount(threads);
+		// The active set is built by the first step, not measured
+		restore();
+		simulateScene(0.0, true);
+		measure("scene_step", MaxParticles, threads, repeat, NULL, [&] {
+			simulateScene(delta, true);
+		});
+		measure("scene_sort", MaxParticles, threads, repeat, restore, [&] {
+			sortScene(CameraPosition);
+		});
+	}
+	setThreadCount(0);
+}
+
+// Texture and shader loading, needs a GL context
+static bool benchmarkLoaders(int repeat) {
+	if (!glfwInit()) {
+		fprintf(stderr, "Failed to initialize GLFW\n");
+		return false;
+	}
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "Benchmark", NULL, NULL);
+	if (window == NULL) {
+		fprintf(stderr, "Failed to open GLFW window\n");
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(window);
+	glewExperimental = true; // Needed for core profile
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		glfwTerminate();
+		return false;
+	}
+
+	GLuint texture = 0, program = 0;
+	measure("load_dds", 0, 1, repeat, NULL, [&] {
+		texture = loadDDS("particle.DDS");
+		glFinish();
+	});
+	glDeleteTextures(1, &texture);
+	measure("load_dds_async", 0, 1, repeat, cleanupTextures, [&] {
+		waitForTexture(requestTexture("particle.DDS"));
+		glFinish();
+	});
+	measure("load_dds_cached", 0, 1, repeat, NULL, [&] {
+		waitForTexture(requestTexture("particle.DDS"));
+	});
+	cleanupTextures();
+	measure("load_bmp", 0, 1, repeat, NULL, [&] {
+		texture = loadBMP_custom("particle.bmp");
+		glFinish();
+	});
+	glDeleteTextures(1, &texture);
+	setShaderCacheEnabled(false);
+	measure("load_shaders", 0, 1, repeat, NULL, [&] {
+		program = LoadShaders("Particle.vertexshader", "Particle.fragmentshader");
+		glFinish();
+	});
+	glDeleteProgram(program);
+	setShaderCacheEnabled(true);
+	glDeleteProgram(LoadShaders("Particle.vertexshader", "Particle.fragmentshader")); // Fill the cache
+	measure("load_shaders_cached", 0, 1, repeat, NULL, [&] {
+		program = LoadShaders("Particle.vertexshader", "Particle.fragmentshader");
+		glFinish();
+	});
+	glDeleteProgram(program);
+
+	glfwTerminate();
+	return true;
+}
+
+static bool writeResults(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "benchmark,count,threads,median_ms,min_ms\n");
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& r = results[i];
+		fprintf(file, "%s,%d,%d,%.4f,%.4f\n", r.name.c_str(), r.count, r.threads, r.median, r.min);
+	}
+	fclose(file);
+	return true;
+}
+
+// Returns the number of regressions, or -1 if the baseline cannot be read
+static int compareBaseline(const char* path, double tolerance) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		printf("Impossible to open the baseline %s\n", path);
+		return -1;
+	}
+
+	std::vector<BenchmarkResult> baseline;
+	char line[256];
+	while (fgets(line, sizeof(line), file)) {
+		char name[64];
+		BenchmarkResult r;
+		if (sscanf(line, "%63[^,],%d,%d,%lf,%lf", name, &r.count, &r.threads, &r.median, &r.min) != 5) continue; // Header
+		r.name = name;
+		baseline.push_back(r);
+	}
+	fclose(file);
+
+	printf("\nComparison with %s (tolerance %.0f%%)\n", path, 100.0 * tolerance);
+	int regressions = 0;
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchmarkResult& r = results[i];
+		for (size_t j = 0; j < baseline.size(); j++) {
+			const BenchmarkResult& b = baseline[j];
+			if (b.name != r.name || b.count != r.count || b.threads != r.threads) continue;
+			double ratio = r.median / b.median;
+			bool regression = ratio > 1.0 + tolerance && r.median - b.median > 0.01; // Below 10 us, it is noise
+			if (regression) regressions++;
+			printf("%-20s %10d %3d : %10.3f -> %10.3f ms (x%.2f)%s\n", r.name.c_str(), r.count, r.threads,
+				b.median, r.median, ratio, regression ? "  REGRESSION" : "");
+			break;
+		}
+	}
+	printf("%d regression(s)\n", regressions);
+	return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> counts = parseList("5000,50000,500000,5000000,10000000");
+	std::vector<int> threadCounts;
+	int hardwareThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int t = 1; t < hardwareThreads; t *= 2) threadCounts.push_back(t);
+	threadCounts.push_back(hardwareThreads);
+	int repeat = 5;
+	const char* outputPath = "benchmark.csv";
+	const char* baselinePath = NULL;
+	double tolerance = 0.1;
+	bool glFlag = true;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--counts") == 0 && i + 1 < argc) counts = parseList(argv[++i]);
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threadCounts = parseList(argv[++i]);
+		else if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) repeat = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) outputPath = argv[++i];
+		else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) baselinePath = argv[++i];
+		else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) tolerance = atof(argv[++i]);
+		else if (strcmp(argv[i], "--no-gl") == 0) glFlag = false;
+		else fprintf(stderr, "Unknown option %s\n", argv[i]);
+	}
+
+	for (size_t i = 0; i < counts.size(); i++) {
+		if (counts[i] < 2) continue; // The last particle is the marker
+		benchmarkParticles(counts[i], threadCounts, repeat);
+	}
+	benchmarkScene(threadCounts, repeat);
+	if (glFlag && !benchmarkLoaders(repeat)) {
+		return 1;
+	}
+
+	if (!writeResults(outputPath)) return 1;
+	printf("Results written to %s\n", outputPath);
+	if (spatialMismatches > 0) {
+		fprintf(stderr, "%d spatial queries differ from the brute force\n", spatialMismatches);
+		return 1;
+	}
+
+	if (baselinePath != NULL) {
+		return compareBaseline(baselinePath, tolerance) == 0 ? 0 : 1;
+	}
+	return 0;
+}
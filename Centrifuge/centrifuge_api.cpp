@@ -0,0 +1,282 @@
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "forces.hpp"
+#include "parallel.hpp"
+#include "spatial.hpp"
+#include "centrifuge_api.h"
+
+const float defaultRadius = 5.0f; // Same as controls.cpp
+
+struct CentrifugeSimulation {
+	std::vector<Particle> particles; // count particles, then the marker of the rotor as initParticles() lays it out
+	std::vector<glm::vec3> kicks;
+	std::vector<int> chunkLive;
+	int count;
+	float radius, speed, angle;
+	double substep;
+	double time;
+	bool started;
+};
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "The query points are passed as arrays of 3 floats");
+
+// Owner of the index of spatial.hpp, NULL if there is none
+static const CentrifugeSimulation* indexedSimulation = NULL;
+
+template <typename T>
+static int scalarOf() {
+	return sizeof(T) == sizeof(double) ? CENTRIFUGE_FLOAT64 : CENTRIFUGE_FLOAT32;
+}
+
+int centrifuge_abi_version(void) {
+	return CENTRIFUGE_ABI_VERSION;
+}
+
+// Every entry point below catches everything : an exception must not unwind into the C caller
+
+CentrifugeSimulation* centrifuge_create(int count, unsigned int seed) {
+	if (count < 1) return NULL;
+	CentrifugeSimulation* simulation = NULL;
+	try {
+		simulation = new CentrifugeSimulation;
+		simulation->particles.resize(count + 1);
+		simulation->kicks.resize(count + 1);
+		simulation->count = count;
+		simulation->radius = defaultRadius;
+		simulation->speed = centrifugeSpeed;
+		simulation->angle = 0.0f;
+		simulation->substep = 1.0 / 60.0 * timeRatio;
+		simulation->time = 0.0;
+		simulation->started = false;
+		srand(seed);
+		initParticles(&simulation->particles[0], &simulation->kicks[0], count + 1, simulation->radius, simulation->angle);
+		return simulation;
+	}
+	catch (...) {
+		delete simulation;
+		return NULL;
+	}
+}
+
+// Forget the index, after a failure left it half built or half updated
+static void dropSpatialIndex() {
+	cleanupSpatialIndex();
+	indexedSimulation = NULL;
+}
+
+void centrifuge_destroy(CentrifugeSimulation* simulation) {
+	if (simulation == NULL) return;
+	if (simulation == indexedSimulation) dropSpatialIndex();
+	delete simulation;
+}
+
+int centrifuge_set_parameter(CentrifugeSimulation* simulation, int parameter, double value) {
+	if (simulation == NULL) return -1;
+	try {
+		switch (parameter) {
+		case CENTRIFUGE_RADIUS:
+			if (!(value >= 0.0)) return -1;
+			simulation->radius = (float)value;
+			return 0;
+		case CENTRIFUGE_SPEED:
+			simulation->speed = (float)value;
+			return 0;
+		case CENTRIFUGE_ANGLE:
+			simulation->angle = (float)value;
+			return 0;
+		case CENTRIFUGE_SUBSTEP:
+			if (!(value > 0.0)) return -1;
+			simulation->substep = value;
+			return 0;
+		case CENTRIFUGE_THREADS:
+			if (!(value >= 0.0)) return -1;
+			setThreadCount((int)value); // Restarts the worker threads
+			return 0;
+		}
+		return -1;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+double centrifuge_get_parameter(const CentrifugeSimulation* simulation, int parameter) {
+	if (simulation == NULL) return NAN;
+	switch (parameter) {
+	case CENTRIFUGE_RADIUS: return simulation->radius;
+	case CENTRIFUGE_SPEED: return simulation->speed;
+	case CENTRIFUGE_ANGLE: return simulation->angle;
+	case CENTRIFUGE_SUBSTEP: return simulation->substep;
+	case CENTRIFUGE_THREADS: return getThreadCount();
+	}
+	return NAN;
+}
+
+int centrifuge_start(CentrifugeSimulation* simulation) {
+	if (simulation == NULL) return -1;
+	if (simulation->started) return 0;
+	// The particles are on the rim at the speed of the rotor : the kick is added to it
+	Particle* particles = &simulation->particles[0];
+	RotorStep rotor = makeRotorStep(glm::vec3(0, 0, 0), simulation->radius, simulation->speed, simulation->angle);
+	for (int i = 0; i < simulation->count; i++) {
+		integrateParticle<ActiveForces>(particles[i], (SimulationPrecision::Time)0, rotor, false);
+	}
+	boomParticles(particles, &simulation->kicks[0], simulation->count);
+	simulation->started = true;
+	return 0;
+}
+
+int centrifuge_is_started(const CentrifugeSimulation* simulation) {
+	if (simulation == NULL) return -1;
+	return simulation->started ? 1 : 0;
+}
+
+int centrifuge_step(CentrifugeSimulation* simulation, int steps) {
+	if (simulation == NULL || steps < 0) return -1;
+	try {
+		Particle* particles = &simulation->particles[0];
+		int count = simulation->count;
+		SimulationPrecision::Time delta = (SimulationPrecision::Time)simulation->substep;
+		simulation->chunkLive.assign(getChunkCount(count), 0);
+		for (int s = 0; s < steps; s++) {
+			// Same order as the program : the rotor turns, then the particles follow it or fly
+			simulation->angle += simulation->speed * (float)simulation->substep;
+			simulation->time += simulation->substep;
+			RotorStep rotor = makeRotorStep(glm::vec3(0, 0, 0), simulation->radius, simulation->speed, simulation->angle);
+			bool started = simulation->started;
+			parallelFor(count, [&](int begin, int end, int chunk) {
+				int live = 0;
+				for (int i = begin; i < end; i++) {
+					Particle& p = particles[i]; // shortcut
+					if (p.life <= 0.0f) continue;
+					p.life -= (float)delta;
+					if (p.life <= 0.0f) continue;
+					integrateParticle<ActiveForces>(p, delta, rotor, started);
+					live++;
+				}
+				simulation->chunkLive[chunk] = live;
+			});
+		}
+		if (steps == 0) {
+			for (int i = 0; i < count; i++) simulation->chunkLive[0] += particles[i].life > 0.0f;
+		}
+		int live = 0;
+		for (size_t c = 0; c < simulation->chunkLive.size(); c++) live += simulation->chunkLive[c];
+		if (simulation == indexedSimulation) {
+			try {
+				updateSpatialIndex(particles, count);
+			}
+			catch (...) {
+				dropSpatialIndex();
+				throw;
+			}
+		}
+		return live;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+double centrifuge_get_time(const CentrifugeSimulation* simulation) {
+	if (simulation == NULL) return -1.0;
+	return simulation->time;
+}
+
+int centrifuge_get_count(const CentrifugeSimulation* simulation) {
+	if (simulation == NULL) return -1;
+	return simulation->count;
+}
+
+int centrifuge_get_view(const CentrifugeSimulation* simulation, int field, CentrifugeView* view) {
+	if (simulation == NULL || view == NULL) return -1;
+	const Particle* particles = &simulation->particles[0];
+	view->count = simulation->count;
+	view->stride = (int)sizeof(Particle);
+	switch (field) {
+	case CENTRIFUGE_POSITION:
+		view->data = &particles[0].pos[0];
+		view->components = 3;
+		view->scalar = scalarOf<SimulationPrecision::Position>();
+		return 0;
+	case CENTRIFUGE_VELOCITY:
+		view->data = &particles[0].speed[0];
+		view->components = 3;
+		view->scalar = scalarOf<SimulationPrecision::Velocity>();
+		return 0;
+	case CENTRIFUGE_LIFE:
+		view->data = &particles[0].life;
+		view->components = 1;
+		view->scalar = CENTRIFUGE_FLOAT32;
+		return 0;
+	case CENTRIFUGE_ID:
+		view->data = &particles[0].id;
+		view->components = 1;
+		view->scalar = CENTRIFUGE_UINT32;
+		return 0;
+	}
+	return -1;
+}
+
+// ********** Spatial queries **********
+int centrifuge_build_index(CentrifugeSimulation* simulation, float cellSize, float margin) {
+	if (simulation == NULL) return -1;
+	try {
+		// The marker is not indexed, it is not a particle of the cloud
+		buildSpatialIndex(&simulation->particles[0], simulation->count, cellSize, margin);
+		indexedSimulation = simulation;
+		return getIndexedCount();
+	}
+	catch (...) {
+		dropSpatialIndex();
+		return -1;
+	}
+}
+
+// Arguments shared by the batches
+static bool isQueryValid(const CentrifugeSimulation* simulation, int queryCount, const void* centers, const void* results) {
+	if (simulation == NULL || simulation != indexedSimulation || queryCount < 0) return false;
+	return queryCount == 0 || (centers != NULL && results != NULL);
+}
+
+int centrifuge_count_in_radius(const CentrifugeSimulation* simulation, const float* centers, const float* radii, int queryCount, int* counts) {
+	if (!isQueryValid(simulation, queryCount, centers, counts) || (queryCount > 0 && radii == NULL)) return -1;
+	try {
+		countInRadiusBatch(reinterpret_cast<const glm::vec3*>(centers), radii, queryCount, counts);
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+int centrifuge_find_nearest(const CentrifugeSimulation* simulation, const float* centers, int queryCount, int k, unsigned int* ids, float* distances) {
+	if (!isQueryValid(simulation, queryCount, centers, ids) || k < 0) return -1;
+	try {
+		findNearestBatch(reinterpret_cast<const glm::vec3*>(centers), queryCount, k, ids, distances);
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+int centrifuge_count_in_box(const CentrifugeSimulation* simulation, const float* lows, const float* highs, int queryCount, int* counts) {
+	if (!isQueryValid(simulation, queryCount, lows, counts) || (queryCount > 0 && highs == NULL)) return -1;
+	try {
+		countInBoxBatch(reinterpret_cast<const glm::vec3*>(lows), reinterpret_cast<const glm::vec3*>(highs), queryCount, counts);
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+// ********** Spatial queries **********
@@ -0,0 +1,121 @@
+#ifndef CENTRIFUGE_API_H
+#define CENTRIFUGE_API_H
+
+// C interface of the simulation, built as a shared library (CentrifugeLib.vcxproj, or the Makefile on Linux)
+// so that other programs drive it in-process, e.g. Python through ctypes :
+//
+//   lib = ctypes.CDLL("./libcentrifuge.so")
+//   lib.centrifuge_create.restype = ctypes.c_void_p
+//   simulation = ctypes.c_void_p(lib.centrifuge_create(100000, 1))
+//   lib.centrifuge_start(simulation); lib.centrifuge_step(simulation, 600)
+//   view = CentrifugeView(); lib.centrifuge_get_view(simulation, CENTRIFUGE_POSITION, ctypes.byref(view))
+//   positions = numpy.lib.stride_tricks.as_strided(numpy.ctypeslib.as_array(ctypes.cast(view.data,
+//       ctypes.POINTER(ctypes.c_float)), (view.count * view.stride // 4,)), (view.count, 3), (view.stride, 4))
+//
+// A simulation owns its particles : several of them can live side by side, each one stepped by one thread at a time.
+// Only plain C types cross the interface, and enums are passed as int. No exception escapes it : every entry point
+// catches them, out of memory included, and reports a failure. Functions that can fail return a negative value,
+// or NULL, or NaN for centrifuge_get_parameter(). A NULL simulation is such a failure, and nothing for centrifuge_destroy().
+
+#if defined(_WIN32) && defined(CENTRIFUGE_BUILD_LIBRARY)
+#define CENTRIFUGE_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define CENTRIFUGE_API __declspec(dllimport)
+#else
+#define CENTRIFUGE_API __attribute__((visibility("default")))
+#endif
+
+// Changed whenever a signature, an enum value or CentrifugeView changes
+#define CENTRIFUGE_ABI_VERSION 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CentrifugeSimulation CentrifugeSimulation;
+
+// Parameters, may be changed between two calls of centrifuge_step()
+enum CentrifugeParameter {
+	CENTRIFUGE_RADIUS = 0,  // m, where the particles sit before the start
+	CENTRIFUGE_SPEED = 1,   // Angular speed of the rotor, rad/s
+	CENTRIFUGE_ANGLE = 2,   // Current angle of the rotor, rad
+	CENTRIFUGE_SUBSTEP = 3, // Simulated seconds per step
+	CENTRIFUGE_THREADS = 4  // Worker threads, shared by every simulation of the process. 0 : hardware threads
+};
+
+// Per-particle arrays exposed by centrifuge_get_view()
+enum CentrifugeField {
+	CENTRIFUGE_POSITION = 0, // 3 components, m
+	CENTRIFUGE_VELOCITY = 1, // 3 components, m/s
+	CENTRIFUGE_LIFE = 2,     // Remaining life, s. <= 0 : dead, its other fields are stale
+	CENTRIFUGE_ID = 3        // Index of the particle at creation
+};
+
+enum CentrifugeScalar {
+	CENTRIFUGE_FLOAT32 = 0,
+	CENTRIFUGE_FLOAT64 = 1, // Positions and velocities of a library built with a double precision policy
+	CENTRIFUGE_UINT32 = 2
+};
+
+// Strided view of one field, straight into the particles of the simulation : nothing is copied.
+// Component c of particle i is at (char*)data + i * stride + c * size of the scalar.
+// Valid until the next centrifuge_step(), centrifuge_start() or centrifuge_destroy() of this simulation.
+typedef struct CentrifugeView {
+	const void* data;
+	int count; // Particles
+	int components; // 1 or 3, contiguous
+	int scalar; // CentrifugeScalar
+	int stride; // Bytes from a particle to the next
+} CentrifugeView;
+
+CENTRIFUGE_API int centrifuge_abi_version(void);
+
+// count particles at rest on the rim of a rotor of the default radius and speed. The boom kicks are drawn from seed
+// (through the C library rand(), so creations should not race with other users of it). NULL if count < 1 or out of memory.
+CENTRIFUGE_API CentrifugeSimulation* centrifuge_create(int count, unsigned int seed);
+CENTRIFUGE_API void centrifuge_destroy(CentrifugeSimulation* simulation);
+
+// Returns 0, or -1 for an unknown parameter or an invalid value (negative radius or substep)
+CENTRIFUGE_API int centrifuge_set_parameter(CentrifugeSimulation* simulation, int parameter, double value);
+// NaN for an unknown parameter : the speed and the angle may be negative
+CENTRIFUGE_API double centrifuge_get_parameter(const CentrifugeSimulation* simulation, int parameter);
+
+// The boom : every particle gets its kick and leaves the rim. Only the first call does something. Returns 0, or -1.
+CENTRIFUGE_API int centrifuge_start(CentrifugeSimulation* simulation);
+// 1 or 0, or -1
+CENTRIFUGE_API int centrifuge_is_started(const CentrifugeSimulation* simulation);
+
+// Advance steps fixed substeps. Returns the number of live particles, or -1 if steps < 0 or the step failed.
+CENTRIFUGE_API int centrifuge_step(CentrifugeSimulation* simulation, int steps);
+// Simulated seconds since the creation, or -1
+CENTRIFUGE_API double centrifuge_get_time(const CentrifugeSimulation* simulation);
+// Or -1
+CENTRIFUGE_API int centrifuge_get_count(const CentrifugeSimulation* simulation);
+
+// Returns 0, or -1 for an unknown field or a NULL view
+CENTRIFUGE_API int centrifuge_get_view(const CentrifugeSimulation* simulation, int field, CentrifugeView* view);
+
+// ********** Spatial queries **********
+// Over the live particles, through the hashed grid of spatial.hpp. There is one index per process : it covers the
+// simulation of the last centrifuge_build_index(), and the queries on another simulation fail.
+// centrifuge_step() keeps it up to date, it is only rebuilt once a particle moved beyond the margin.
+// Points are 3 contiguous floats (x, y, z) per query, results are particle IDs (CENTRIFUGE_ID).
+// The queries of a simulation may run concurrently, but not with its steps.
+
+// cellSize <= 0 picks one from the density of the cloud, margin < 0 is a quarter of the cell.
+// Returns the number of particles indexed, or -1 : the index is then gone, whatever simulation it covered.
+CENTRIFUGE_API int centrifuge_build_index(CentrifugeSimulation* simulation, float cellSize, float margin);
+// counts[q] : particles within radii[q] of query q. Returns 0, or -1.
+CENTRIFUGE_API int centrifuge_count_in_radius(const CentrifugeSimulation* simulation, const float* centers, const float* radii, int queryCount, int* counts);
+// k IDs per query, nearest first, padded with 0xFFFFFFFF, and their distances (distances may be NULL) padded with -1.
+// Returns 0, or -1.
+CENTRIFUGE_API int centrifuge_find_nearest(const CentrifugeSimulation* simulation, const float* centers, int queryCount, int k, unsigned int* ids, float* distances);
+// counts[q] : particles inside the box [lows[q], highs[q]]. Returns 0, or -1.
+CENTRIFUGE_API int centrifuge_count_in_box(const CentrifugeSimulation* simulation, const float* lows, const float* highs, int queryCount, int* counts);
+// ********** Spatial queries **********
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
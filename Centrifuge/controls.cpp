@@ -12,6 +12,8 @@ using namespace glm;
 glm::mat4 ViewMatrix;
 glm::mat4 ProjectionMatrix;
 glm::vec3 CameraPosition;
+glm::mat4 RotorViewMatrix;
+glm::vec3 RotorCameraPosition;
 bool rotateFlag = false; // Rotation start flag. If TRUE, rotation will begin.
 bool moveFlag = false; // Move start flag. If TRUE, move will begin.
 bool noninertialFlag = false; // Noninertial view flag. If TRUE, the view will from the centrifuge.
@@ -27,6 +29,12 @@ glm::mat4 getProjectionMatrix() {
 glm::vec3 getCameraPosition() {
 	return CameraPosition;
 }
+glm::mat4 getRotorViewMatrix() {
+	return RotorViewMatrix;
+}
+glm::vec3 getRotorCameraPosition() {
+	return RotorCameraPosition;
+}
 bool getRotateFlag() {
 	return rotateFlag;
 }
@@ -76,20 +84,42 @@ void AddScrollOffset(double offset) {
 	viewDistance -= distanceSpeed * offset;
 }
 
+glm::mat4 getProjectionMatrix(float aspect) {
+	return glm::perspective(glm::radians(initialFoV), aspect, 0.1f, 1000.0f);
+}
+
+CameraPose getCameraPose() {
+	CameraPose pose = { horizontalAngle, verticalAngle, viewDistance, centerPoint };
+	return pose;
+}
+
+void setCameraPose(const CameraPose& pose) {
+	horizontalAngle = pose.horizontalAngle;
+	verticalAngle = pose.verticalAngle;
+	viewDistance = pose.viewDistance;
+	centerPoint = pose.centerPoint;
+}
+
 void computeMatricesFromInputs() {
 
-	// glfwGetTime and glfwGetCursorPos is called only once, the first time this function is called
+	// Get mouse position
+	double xpos, ypos;
+	glfwGetCursorPos(window, &xpos, &ypos);
+
+	computeMatricesFromCursor(xpos, ypos);
+}
+
+void computeMatricesFromCursor(double xpos, double ypos) {
+
+	// The last position is only initialized the first time this function is called
 	static bool firstCall = true;
 	static double lastxpos, lastypos;
 	if (firstCall) {
-		glfwGetCursorPos(window, &lastxpos, &lastypos);
+		lastxpos = xpos;
+		lastypos = ypos;
 		firstCall = false;
 	}
 
-	// Get mouse position
-	double xpos, ypos;
-	glfwGetCursorPos(window, &xpos, &ypos);
-
 	// Compute new orientation
 	if (rotateFlag) {
 		horizontalAngle += rotateSpeed * float(lastxpos - xpos);
@@ -139,6 +169,11 @@ void computeMatricesFromInputs() {
 		up                  // Head is up (set to 0,-1,0 to look upside-down)
 	);
 
+	// Rotor view, the same as the noninertial one above but without moving the center point of the lab view
+	glm::vec3 rimPoint(centrifugeRadius*sin(centrifugeAngle), centrifugeRadius*cos(centrifugeAngle), 0);
+	RotorCameraPosition = direction * (-viewDistance) + rimPoint;
+	RotorViewMatrix = glm::lookAt(RotorCameraPosition, rimPoint, glm::vec3(-sin(centrifugeAngle), -cos(centrifugeAngle), 0));
+
 	// Reset the position
 	lastxpos = xpos;
 	lastypos = ypos;
@@ -2,9 +2,16 @@
 #define CONTROLS_HPP
 
 void computeMatricesFromInputs();
+// Same as computeMatricesFromInputs(), with a cursor position read elsewhere (GLFW input is main thread only)
+void computeMatricesFromCursor(double xpos, double ypos);
 glm::mat4 getViewMatrix();
 glm::mat4 getProjectionMatrix();
+// Same field of view for another viewport shape, e.g. half of the window
+glm::mat4 getProjectionMatrix(float aspect);
 glm::vec3 getCameraPosition();
+// The rotor view, computed whatever the noninertial flag : the same orbit around the rim, turning with the rotor
+glm::mat4 getRotorViewMatrix();
+glm::vec3 getRotorCameraPosition();
 bool getRotateFlag();
 void setRotateFlag(bool flag);
 bool getMoveFlag();
@@ -16,4 +23,14 @@ void setCentrifugeAngle(float angle);
 float getCentrifugeRadius();
 void AddScrollOffset(double offset);
 
+// Orbit of the camera around its center point, what the mouse changes
+struct CameraPose {
+	float horizontalAngle, verticalAngle; // rad
+	float viewDistance;
+	glm::vec3 centerPoint;
+};
+CameraPose getCameraPose();
+// Takes effect at the next computeMatricesFromCursor()
+void setCameraPose(const CameraPose& pose);
+
 #endif
\ No newline at end of file
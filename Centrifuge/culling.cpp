@@ -0,0 +1,38 @@
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "culling.hpp"
+
+ViewCull makeViewCull(const glm::mat4& ViewProjectionMatrix, const glm::vec3& cameraPosition, float lodDistance, float subsample) {
+	ViewCull cull;
+
+	// Gribb-Hartmann : the planes are sums and differences of the rows of the matrix
+	glm::mat4 m = transpose(ViewProjectionMatrix);
+	cull.planes[0] = m[3] + m[0];
+	cull.planes[1] = m[3] - m[0];
+	cull.planes[2] = m[3] + m[1];
+	cull.planes[3] = m[3] - m[1];
+	cull.planes[4] = m[3] + m[2];
+	cull.planes[5] = m[3] - m[2];
+	for (int i = 0; i < 6; i++) {
+		cull.planes[i] /= length(glm::vec3(cull.planes[i]));
+	}
+
+	cull.cameraPosition = cameraPosition;
+	cull.lodDistance2 = lodDistance * lodDistance;
+	cull.subsample = subsample;
+	return cull;
+}
+
+ViewCull makeSubsampleCull(float subsample) {
+	ViewCull cull;
+	for (int i = 0; i < 6; i++) {
+		cull.planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f); // Everything inside
+	}
+	cull.cameraPosition = glm::vec3(0.0f);
+	cull.lodDistance2 = 0.0f;
+	cull.subsample = subsample;
+	return cull;
+}
@@ -0,0 +1,40 @@
+#ifndef CULLING_HPP
+#define CULLING_HPP
+
+// Beyond this distance to the camera particles are randomly thinned, keeping (lodDistance / distance)^2 of them.
+// Particle.vertexshader scales the alpha of the survivors by the inverse to keep the same overall density.
+const float lodDistance = 150.0f;
+
+// What the camera can see this frame
+struct ViewCull {
+	glm::vec4 planes[6]; // Left, right, bottom, top, near, far. Inside if dot(plane, (pos, 1)) >= 0
+	glm::vec3 cameraPosition;
+	float lodDistance2; // Squared LOD distance, 0 disables the thinning
+	float subsample; // Fraction of the particles kept at any distance, on top of the thinning, see governor.hpp
+};
+
+ViewCull makeViewCull(const glm::mat4& ViewProjectionMatrix, const glm::vec3& cameraPosition, float lodDistance, float subsample = 1.0f);
+// No frustum and no thinning, only the subsampling : for views that need every particle, e.g. the split view
+ViewCull makeSubsampleCull(float subsample);
+
+// Frustum test of the particle's square, followed by the subsampling and the distance based thinning.
+// Both only depend on the particle ID, so a particle does not flicker from frame to frame, and the particles
+// kept by a smaller fraction are a subset of the ones kept by a larger one.
+inline bool isParticleVisible(const ViewCull& cull, const Particle& p) {
+	float radius = 0.71f * p.size; // Half the diagonal of the square
+	glm::vec3 pos(p.pos); // Float whatever the simulation precision
+	for (int i = 0; i < 6; i++) {
+		if (glm::dot(glm::vec3(cull.planes[i]), pos) + cull.planes[i].w < -radius) return false;
+	}
+	if (cull.lodDistance2 > 0.0f || cull.subsample < 1.0f) {
+		float u = ((p.id * 2654435761u) >> 8) * (1.0f / 16777216.0f); // Uniform in [0, 1)
+		if (u >= cull.subsample) return false;
+		if (cull.lodDistance2 > 0.0f) {
+			float distance2 = glm::dot(pos - cull.cameraPosition, pos - cull.cameraPosition);
+			if (distance2 > cull.lodDistance2 && u * distance2 >= cull.lodDistance2 * cull.subsample) return false;
+		}
+	}
+	return true;
+}
+
+#endif
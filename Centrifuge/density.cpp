@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "shader.hpp"
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "density.hpp"
+
+const int DensityCells = DensityWidth * DensityHeight;
+
+static std::vector<unsigned int> histograms; // One grid per chunk, reused from frame to frame
+static std::vector<float> chunkMax;
+
+float splatDensity(const Particle* particles, int count, const glm::mat4& ViewProjectionMatrix, float* density) {
+	int chunks = getChunkCount(count);
+	histograms.resize((size_t)chunks * DensityCells);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		// Private histogram : no atomics, no shared cache lines
+		unsigned int* histogram = &histograms[(size_t)chunk * DensityCells];
+		std::fill(histogram, histogram + DensityCells, 0);
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			glm::vec4 clip = ViewProjectionMatrix * glm::vec4(p.pos, 1.0f);
+			if (clip.w <= 0.0f) continue; // Behind the camera
+			float x = (clip.x / clip.w * 0.5f + 0.5f) * DensityWidth;
+			float y = (clip.y / clip.w * 0.5f + 0.5f) * DensityHeight;
+			if (x < 0.0f || y < 0.0f || x >= DensityWidth || y >= DensityHeight) continue;
+			histogram[(int)y * DensityWidth + (int)x]++;
+		}
+	});
+
+	// Merge, split by cells this time
+	int mergeChunks = getChunkCount(DensityCells);
+	chunkMax.assign(mergeChunks, 0.0f);
+	parallelFor(DensityCells, [&](int begin, int end, int chunk) {
+		float highest = 0.0f;
+		for (int c = begin; c < end; c++) {
+			unsigned int sum = 0;
+			for (int h = 0; h < chunks; h++) sum += histograms[(size_t)h * DensityCells + c];
+			density[c] = (float)sum;
+			highest = std::max(highest, density[c]);
+		}
+		chunkMax[chunk] = highest;
+	});
+	return *std::max_element(chunkMax.begin(), chunkMax.end());
+}
+
+static GLuint densityProgramID = 0;
+static GLuint densityTexture = 0;
+static GLint DensitySamplerID, MaxDensityID;
+
+bool initDensityRenderer() {
+	densityProgramID = LoadShaders("Density.vertexshader", "Density.fragmentshader");
+	if (densityProgramID == 0) {
+		fprintf(stderr, "Failed to build the density program\n");
+		return false;
+	}
+	DensitySamplerID = glGetUniformLocation(densityProgramID, "densitySampler");
+	MaxDensityID = glGetUniformLocation(densityProgramID, "maxDensity");
+
+	glGenTextures(1, &densityTexture);
+	glBindTexture(GL_TEXTURE_2D, densityTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, DensityWidth, DensityHeight, 0, GL_RED, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return true;
+}
+
+void drawDensity(const float* density, float maxDensity) {
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, densityTexture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, DensityWidth, DensityHeight, GL_RED, GL_FLOAT, density);
+
+	glUseProgram(densityProgramID);
+	glUniform1i(DensitySamplerID, 0);
+	glUniform1f(MaxDensityID, maxDensity);
+
+	// Over everything, the axes are drawn afterwards
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glEnable(GL_DEPTH_TEST);
+}
+
+void cleanupDensityRenderer() {
+	glDeleteTextures(1, &densityTexture);
+	glDeleteProgram(densityProgramID);
+}
@@ -0,0 +1,19 @@
+#ifndef DENSITY_HPP
+#define DENSITY_HPP
+
+// Density view : the particles are binned into a screen space grid on the CPU and the grid is drawn
+// as a colour mapped texture, so the draw cost depends on the grid resolution, not on the particle count.
+const int DensityWidth = 256;
+const int DensityHeight = 192; // Same aspect as the window
+
+// Count the live particles falling in each cell of the grid, as seen through ViewProjectionMatrix.
+// Each chunk bins into its own histogram, the histograms are merged in parallel. Returns the highest count.
+float splatDensity(const Particle* particles, int count, const glm::mat4& ViewProjectionMatrix, float* density);
+
+// GL side, on the GL thread
+bool initDensityRenderer();
+// Upload the grid and draw it over the whole viewport, log scaled to maxDensity
+void drawDensity(const float* density, float maxDensity);
+void cleanupDensityRenderer();
+
+#endif
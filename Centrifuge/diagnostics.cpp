@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "diagnostics.hpp"
+
+PhysicsDiagnostics computeDiagnostics(const Particle* particles, int count, const unsigned int* markerIds, int markerCount) {
+	std::vector<PhysicsDiagnostics> partials(getChunkCount(count));
+	std::vector<unsigned int> markers(markerIds, markerIds + markerCount);
+	std::sort(markers.begin(), markers.end());
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		// Accumulate in locals, the partials of neighbouring chunks share cache lines
+		int live = 0;
+		double kinetic = 0.0, potential = 0.0, angular = 0.0, squaredRadius = 0.0;
+		glm::dvec3 momentum(0.0), position(0.0);
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f || std::binary_search(markers.begin(), markers.end(), p.id)) continue;
+			glm::dvec3 pos(p.pos), speed(p.speed);
+			live++;
+			kinetic += 0.5 * dot(speed, speed);
+			potential += gravityAcceleraion * pos.z;
+			momentum += speed;
+			angular += pos.x * speed.y - pos.y * speed.x;
+			position += pos;
+			squaredRadius += pos.x * pos.x + pos.y * pos.y;
+		}
+		PhysicsDiagnostics& partial = partials[chunk];
+		partial.count = live;
+		partial.kineticEnergy = kinetic;
+		partial.potentialEnergy = potential;
+		partial.momentum = momentum;
+		partial.angularMomentum = angular;
+		partial.centerOfMass = position; // Sum of the positions until the merge
+		partial.sumSquaredRadius = squaredRadius;
+	});
+
+	PhysicsDiagnostics total = PhysicsDiagnostics();
+	for (size_t c = 0; c < partials.size(); c++) {
+		total.count += partials[c].count;
+		total.kineticEnergy += partials[c].kineticEnergy;
+		total.potentialEnergy += partials[c].potentialEnergy;
+		total.momentum += partials[c].momentum;
+		total.angularMomentum += partials[c].angularMomentum;
+		total.centerOfMass += partials[c].centerOfMass;
+		total.sumSquaredRadius += partials[c].sumSquaredRadius;
+	}
+	if (total.count > 0) total.centerOfMass /= (double)total.count;
+	return total;
+}
+
+bool checkDiagnostics(const PhysicsDiagnostics& reference, const PhysicsDiagnostics& current, double elapsed, double tolerance, bool freeFall) {
+	printf("t=%8.3f  E=%12.4f (K=%12.4f U=%12.4f)  P=(%10.4f %10.4f %10.4f)  Lz=%12.4f  CoM=(%8.3f %8.3f %8.3f)\n",
+		elapsed, current.kineticEnergy + current.potentialEnergy, current.kineticEnergy, current.potentialEnergy,
+		current.momentum.x, current.momentum.y, current.momentum.z, current.angularMomentum,
+		current.centerOfMass.x, current.centerOfMass.y, current.centerOfMass.z);
+
+	if (!freeFall) return true;
+	if (current.count != reference.count) {
+		printf("  Particle count changed (%d -> %d), the invariants are not comparable\n", reference.count, current.count);
+		return true;
+	}
+
+	// Each drift is relative to the magnitude the quantity could have, so that a near zero sum does not blow up the ratio
+	double energyScale = fabs(reference.kineticEnergy) + fabs(reference.potentialEnergy) + 1e-12;
+	double momentumScale = sqrt(2.0 * reference.count * reference.kineticEnergy) + 1e-12; // >= sum of |v|
+	double angularScale = sqrt(reference.sumSquaredRadius * 2.0 * reference.kineticEnergy) + 1e-12; // >= sum of |r x v|.z
+
+	double referenceEnergy = reference.kineticEnergy + reference.potentialEnergy;
+	double currentEnergy = current.kineticEnergy + current.potentialEnergy;
+	glm::dvec3 expectedMomentum = reference.momentum - glm::dvec3(0.0, 0.0, reference.count * gravityAcceleraion * elapsed);
+
+	double drifts[4] = {
+		fabs(currentEnergy - referenceEnergy) / energyScale,
+		length(glm::dvec2(current.momentum - expectedMomentum)) / momentumScale,
+		fabs(current.momentum.z - expectedMomentum.z) / momentumScale,
+		fabs(current.angularMomentum - reference.angularMomentum) / angularScale
+	};
+	const char* names[4] = { "energy", "horizontal momentum", "vertical momentum", "angular momentum" };
+
+	bool sane = true;
+	for (int i = 0; i < 4; i++) {
+		if (drifts[i] > tolerance) {
+			printf("  DRIFT : %s off by %.3f%% (tolerance %.3f%%)\n", names[i], 100.0 * drifts[i], 100.0 * tolerance);
+			sane = false;
+		}
+	}
+	return sane;
+}
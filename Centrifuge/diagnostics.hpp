@@ -0,0 +1,27 @@
+#ifndef DIAGNOSTICS_HPP
+#define DIAGNOSTICS_HPP
+
+// Global physical quantities of the cloud, every particle having a unit mass.
+// The rotor axis is z, gravity is along -z.
+struct PhysicsDiagnostics {
+	int count; // Live particles, the markers excluded
+	double kineticEnergy;
+	double potentialEnergy; // Gravity, z = 0 as reference
+	glm::dvec3 momentum;
+	double angularMomentum; // About the rotor axis
+	glm::dvec3 centerOfMass;
+	double sumSquaredRadius; // Sum of the squared distances to the axis, scales the angular momentum drift
+};
+
+// Parallel reduction over the live particles, partial sums are merged in chunk order so the result does not depend on the thread count.
+// markerIds : IDs of the markers of the rotors, which are not debris, one per group (see scene.hpp)
+PhysicsDiagnostics computeDiagnostics(const Particle* particles, int count, const unsigned int* markerIds, int markerCount);
+
+// After the boom the particles only feel gravity : energy, horizontal momentum and angular momentum are conserved,
+// and the vertical momentum decreases by count * g * elapsed.
+// Prints the quantities, and the drift of each invariant relative to the reference. Returns false if one of them exceeds the tolerance.
+// freeFall : FALSE if something else acts on the particles (the drag, the walls of the fluid tube, the floor of the
+// sleeping region) : nothing is conserved, only the quantities are printed.
+bool checkDiagnostics(const PhysicsDiagnostics& reference, const PhysicsDiagnostics& current, double elapsed, double tolerance, bool freeFall);
+
+#endif
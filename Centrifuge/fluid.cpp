@@ -0,0 +1,344 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "fluid.hpp"
+
+const float Pi = 3.14159265f;
+const float CourantNumber = 0.4f;
+
+static bool fluidFlag = false;
+static FluidParameters fluid;
+static float smoothingLength = 1.0f; // h
+static float particleMass = 1.0f;
+static float soundSpeed = 1.0f;
+static float stiffness = 1.0f; // soundSpeed^2 : p = stiffness * (density - restDensity)
+static float tubeBottom, tubeTop, tubeHalfWidth; // Radial extent of the tube and half of its section, in the rotor frame
+static float wallRange; // The walls push the particles closer than this, half the rest spacing like the lattice
+static float wallStiffness, wallDamping; // Acceleration per meter inside the range, per m/s towards the wall
+
+// Normalisation of the cubic spline kernel, for the current smoothing length
+static float kernelNormal;
+
+// Cell list : the particles of cell c are the ranks [cellStart[c], cellStart[c + 1]), in x fastest order.
+// Cells of h / 2, searched 2 cells around : 125 cells of 1 particle hold fewer candidates than 27 cells of 8.
+const int CellsPerKernel = 2;
+static float cellSize = 1.0f;
+static glm::vec3 gridOrigin;
+static glm::ivec3 gridSize;
+static std::vector<int> cellStart;
+static std::vector<int> cellOfSlot; // Cell of each particle of the array
+static std::vector<int> order; // Slot of each rank
+
+// Per rank, in cell order
+static std::vector<glm::vec3> sortedPos, sortedSpeed, sortedAccel;
+static std::vector<float> sortedDensity, sortedPressure;
+
+static std::vector<glm::vec3> chunkLow, chunkHigh;
+
+// Cubic spline of support h, and its derivative along the distance, q = distance / h
+static inline float kernel(float q) {
+	if (q >= 1.0f) return 0.0f;
+	if (q <= 0.5f) return kernelNormal * (6.0f * (q * q * q - q * q) + 1.0f);
+	return kernelNormal * 2.0f * (1.0f - q) * (1.0f - q) * (1.0f - q);
+}
+
+static inline float kernelDerivative(float q) {
+	if (q >= 1.0f) return 0.0f;
+	if (q <= 0.5f) return kernelNormal / smoothingLength * 6.0f * (3.0f * q * q - 2.0f * q);
+	return -kernelNormal / smoothingLength * 6.0f * (1.0f - q) * (1.0f - q);
+}
+
+void initFluid(Particle* particles, int count, const FluidParameters& parameters, const glm::vec3& center, float radius, float speed, float angle) {
+	fluid = parameters;
+
+	// Tube of square section, half as deep as the radius, the liquid sits at its bottom
+	tubeHalfWidth = 0.15f * radius;
+	tubeBottom = radius;
+	tubeTop = 0.5f * radius;
+	float column = fluid.fillRatio * (tubeBottom - tubeTop);
+
+	// Lattice of n x n x m particles, spacing = h / 2, filling the column
+	float volume = 4.0f * tubeHalfWidth * tubeHalfWidth * column;
+	float spacing = (float)cbrt(volume / count);
+	int n = std::max(1, (int)floor(2.0f * tubeHalfWidth / spacing));
+	smoothingLength = 2.0f * spacing;
+	cellSize = smoothingLength / CellsPerKernel;
+	kernelNormal = 8.0f / (Pi * smoothingLength * smoothingLength * smoothingLength);
+
+	// Mass such that the inside of the lattice is exactly at the rest density, and starts without pressure
+	float latticeSum = 0.0f;
+	for (int z = -2; z <= 2; z++) {
+		for (int y = -2; y <= 2; y++) {
+			for (int x = -2; x <= 2; x++) {
+				latticeSum += kernel(spacing * sqrt((float)(x * x + y * y + z * z)) / smoothingLength);
+			}
+		}
+	}
+	particleMass = fluid.restDensity / latticeSum;
+
+	// The pressure at the bottom of the column is about density * (omega^2 R + g) * column
+	float acceleration = speed * speed * radius + gravityAcceleraion;
+	soundSpeed = sqrt(acceleration * column / fluid.densityVariation);
+	stiffness = soundSpeed * soundSpeed;
+	// Walls as stiff as the liquid : a layer against them oscillates no faster than sound crosses a kernel
+	wallRange = 0.5f * spacing;
+	wallStiffness = stiffness / (smoothingLength * smoothingLength);
+	wallDamping = sqrt(wallStiffness);
+
+	glm::vec3 radial(sin(angle), cos(angle), 0.0f);
+	glm::vec3 tangent(cos(angle), -sin(angle), 0.0f);
+	for (int i = 0; i < count; i++) {
+		Particle& p = particles[i]; // shortcut
+		int u = i / (n * n), t = i % n, z = (i / n) % n;
+		glm::vec3 local(tubeBottom - (u + 0.5f) * spacing, (t + 0.5f) * spacing - tubeHalfWidth, (z + 0.5f) * spacing - tubeHalfWidth);
+		glm::vec3 relative = local.x * radial + local.y * tangent;
+		p.pos = center + relative + glm::vec3(0.0f, 0.0f, local.z);
+		p.speed = speed * glm::vec3(relative.y, -relative.x, 0.0f); // Rigid rotation with the rotor
+		p.size = 1.5f * spacing;
+		p.r = 30 + rand() % 40;
+		p.g = 110 + rand() % 60;
+		p.b = 200 + rand() % 56;
+		p.a = 200;
+	}
+	fluidFlag = true;
+	printf("Fluid : %d particles, h = %.3f m, %d x %d x %d lattice, speed of sound %.1f m/s\n",
+		count, smoothingLength, n, n, (count + n * n - 1) / (n * n), soundSpeed);
+}
+
+bool isFluidEnabled() {
+	return fluidFlag;
+}
+
+float getFluidSmoothingLength() {
+	return smoothingLength;
+}
+
+void cleanupFluid() {
+	fluidFlag = false;
+	std::vector<int>().swap(cellStart);
+	std::vector<int>().swap(cellOfSlot);
+	std::vector<int>().swap(order);
+	std::vector<glm::vec3>().swap(sortedPos);
+	std::vector<glm::vec3>().swap(sortedSpeed);
+	std::vector<glm::vec3>().swap(sortedAccel);
+	std::vector<float>().swap(sortedDensity);
+	std::vector<float>().swap(sortedPressure);
+}
+
+// Bin the particles into cells and gather them in cell order
+static void buildCellList(const Particle* particles, int count) {
+	int chunks = getChunkCount(count);
+	chunkLow.assign(chunks, glm::vec3(1e30f));
+	chunkHigh.assign(chunks, glm::vec3(-1e30f));
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		glm::vec3 low(1e30f), high(-1e30f);
+		for (int i = begin; i < end; i++) {
+			glm::vec3 pos(particles[i].pos);
+			low = glm::min(low, pos);
+			high = glm::max(high, pos);
+		}
+		chunkLow[chunk] = low;
+		chunkHigh[chunk] = high;
+	});
+	glm::vec3 low = chunkLow[0], high = chunkHigh[0];
+	for (int c = 1; c < chunks; c++) {
+		low = glm::min(low, chunkLow[c]);
+		high = glm::max(high, chunkHigh[c]);
+	}
+	gridOrigin = low;
+	gridSize = glm::ivec3((high - low) / cellSize) + glm::ivec3(1);
+	int cells = gridSize.x * gridSize.y * gridSize.z;
+
+	cellOfSlot.resize(count);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			glm::ivec3 cell = glm::min(glm::ivec3((glm::vec3(particles[i].pos) - gridOrigin) / cellSize), gridSize - 1);
+			cellOfSlot[i] = (cell.z * gridSize.y + cell.y) * gridSize.x + cell.x;
+		}
+	});
+
+	// Counting sort by cell. Serial, so that the order (and the sums of the kernels) is the same from run to run.
+	cellStart.assign(cells + 1, 0);
+	for (int i = 0; i < count; i++) cellStart[cellOfSlot[i] + 1]++;
+	for (int c = 0; c < cells; c++) cellStart[c + 1] += cellStart[c];
+	order.resize(count);
+	std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+	for (int i = 0; i < count; i++) order[next[cellOfSlot[i]]++] = i;
+
+	sortedPos.resize(count);
+	sortedSpeed.resize(count);
+	sortedAccel.resize(count);
+	sortedDensity.resize(count);
+	sortedPressure.resize(count);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int r = begin; r < end; r++) {
+			sortedPos[r] = glm::vec3(particles[order[r]].pos);
+			sortedSpeed[r] = glm::vec3(particles[order[r]].speed);
+		}
+	});
+}
+
+// Call visit(rank) for every particle of the cells within h of pos. The cells of a row are contiguous in the list.
+template <typename Visitor>
+static void visitNeighbours(const glm::vec3& pos, const Visitor& visit) {
+	glm::ivec3 cell = glm::min(glm::ivec3((pos - gridOrigin) / cellSize), gridSize - 1);
+	int xBegin = std::max(cell.x - CellsPerKernel, 0), xEnd = std::min(cell.x + CellsPerKernel, gridSize.x - 1);
+	for (int z = std::max(cell.z - CellsPerKernel, 0); z <= std::min(cell.z + CellsPerKernel, gridSize.z - 1); z++) {
+		for (int y = std::max(cell.y - CellsPerKernel, 0); y <= std::min(cell.y + CellsPerKernel, gridSize.y - 1); y++) {
+			int row = (z * gridSize.y + y) * gridSize.x;
+			for (int r = cellStart[row + xBegin]; r < cellStart[row + xEnd + 1]; r++) visit(r);
+		}
+	}
+}
+
+static void computeDensity(int count) {
+	float h2 = smoothingLength * smoothingLength;
+	float inverseH = 1.0f / smoothingLength;
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int r = begin; r < end; r++) {
+			const glm::vec3 pos = sortedPos[r];
+			float sum = 0.0f;
+			visitNeighbours(pos, [&](int j) {
+				glm::vec3 d = pos - sortedPos[j];
+				float d2 = glm::dot(d, d);
+				if (d2 < h2) sum += kernel(sqrt(d2) * inverseH);
+			});
+			sortedDensity[r] = particleMass * sum;
+			// No tension : a free surface would pull the particles into clumps
+			sortedPressure[r] = std::max(0.0f, stiffness * (sortedDensity[r] - fluid.restDensity));
+		}
+	}, MinParallelChunk / 16);
+}
+
+// Symmetric pressure gradient, and the artificial viscosity of Monaghan : both are central forces,
+// so the liquid keeps its momentum and angular momentum, and a rigid rotation is left alone
+static void computeAcceleration(int count) {
+	float h = smoothingLength;
+	float h2 = h * h;
+	float inverseH = 1.0f / h;
+	float viscosityScale = 2.0f * fluid.viscosity * h * soundSpeed;
+	glm::vec3 gravity(0.0f, 0.0f, -gravityAcceleraion);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int r = begin; r < end; r++) {
+			const glm::vec3 pos = sortedPos[r];
+			const glm::vec3 speed = sortedSpeed[r];
+			float density = sortedDensity[r];
+			float pressureTerm = sortedPressure[r] / (density * density);
+			glm::vec3 acceleration(0.0f);
+			visitNeighbours(pos, [&](int j) {
+				glm::vec3 d = pos - sortedPos[j];
+				float d2 = glm::dot(d, d);
+				if (d2 >= h2 || d2 == 0.0f) return;
+				float distance = sqrt(d2);
+				float term = pressureTerm + sortedPressure[j] / (sortedDensity[j] * sortedDensity[j]);
+				float approach = glm::dot(speed - sortedSpeed[j], d);
+				if (approach < 0.0f) {
+					// Only between particles closing in
+					term -= viscosityScale / (density + sortedDensity[j]) * approach / (d2 + 0.01f * h2);
+				}
+				acceleration -= (term * kernelDerivative(distance * inverseH) / distance) * d;
+			});
+			sortedAccel[r] = gravity + particleMass * acceleration;
+		}
+	}, MinParallelChunk / 16);
+}
+
+// Rotor frame coordinates (radial, tangential, z) of a point relative to the center, and back
+static glm::vec3 toTube(const glm::vec3& v, const glm::vec3& radial, const glm::vec3& tangent) {
+	return glm::vec3(glm::dot(v, radial), glm::dot(v, tangent), v.z);
+}
+
+static glm::vec3 fromTube(const glm::vec3& local, const glm::vec3& radial, const glm::vec3& tangent) {
+	return local.x * radial + local.y * tangent + glm::vec3(0.0f, 0.0f, local.z);
+}
+
+// Semi-implicit Euler with the push of the walls of the tube (there are no boundary particles), then what still
+// went through a wall is put back on it, without the part of its speed (relative to the moving wall) that went outwards
+static void integrateFluid(Particle* particles, int count, float delta, const glm::vec3& center, float speed, float angle) {
+	// The push is measured where the tube was at the start of the step, the positions are put back where it is at the end
+	float startAngle = angle - speed * delta;
+	glm::vec3 startRadial(sin(startAngle), cos(startAngle), 0.0f);
+	glm::vec3 startTangent(cos(startAngle), -sin(startAngle), 0.0f);
+	glm::vec3 radial(sin(angle), cos(angle), 0.0f);
+	glm::vec3 tangent(cos(angle), -sin(angle), 0.0f);
+	glm::vec3 low(tubeTop, -tubeHalfWidth, -tubeHalfWidth), high(tubeBottom, tubeHalfWidth, tubeHalfWidth);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int r = begin; r < end; r++) {
+			glm::vec3 relative = sortedPos[r] - center;
+			glm::vec3 local = toTube(relative, startRadial, startTangent);
+			glm::vec3 localSlip = toTube(sortedSpeed[r] - speed * glm::vec3(relative.y, -relative.x, 0.0f), startRadial, startTangent);
+			glm::vec3 push(0.0f);
+			for (int k = 0; k < 3; k++) {
+				float d = local[k] - low[k];
+				if (d < wallRange) push[k] += wallStiffness * (wallRange - d) - wallDamping * std::min(localSlip[k], 0.0f);
+				d = high[k] - local[k];
+				if (d < wallRange) push[k] -= wallStiffness * (wallRange - d) + wallDamping * std::max(localSlip[k], 0.0f);
+			}
+
+			glm::vec3 v = sortedSpeed[r] + delta * (sortedAccel[r] + fromTube(push, startRadial, startTangent));
+			relative = sortedPos[r] + delta * v - center;
+			local = toTube(relative, radial, tangent);
+			glm::vec3 wall = speed * glm::vec3(relative.y, -relative.x, 0.0f);
+			localSlip = toTube(v - wall, radial, tangent);
+			for (int k = 0; k < 3; k++) {
+				if (local[k] < low[k]) {
+					local[k] = low[k];
+					localSlip[k] = std::max(localSlip[k], 0.0f);
+				}
+				else if (local[k] > high[k]) {
+					local[k] = high[k];
+					localSlip[k] = std::min(localSlip[k], 0.0f);
+				}
+			}
+			relative = fromTube(local, radial, tangent);
+			wall = speed * glm::vec3(relative.y, -relative.x, 0.0f);
+
+			Particle& p = particles[order[r]]; // shortcut
+			p.pos = center + relative;
+			p.speed = wall + fromTube(localSlip, radial, tangent);
+		}
+	});
+}
+
+// Before the start : the tube and the liquid turn together
+static void rotateFluid(Particle* particles, int count, float delta, const glm::vec3& center, float speed) {
+	float c = cos(speed * delta), s = sin(speed * delta);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			Particle& p = particles[i]; // shortcut
+			glm::vec3 relative = glm::vec3(p.pos) - center;
+			relative = glm::vec3(relative.x * c + relative.y * s, -relative.x * s + relative.y * c, relative.z);
+			p.pos = center + relative;
+			p.speed = speed * glm::vec3(relative.y, -relative.x, 0.0f);
+		}
+	});
+}
+
+int stepFluid(Particle* particles, int count, double delta, const glm::vec3& center, float speed, float angle, bool started) {
+	if (!started) {
+		rotateFluid(particles, count, (float)delta, center, speed);
+		return 1;
+	}
+
+	// Sound must not cross more than a fraction of a kernel per step
+	float maxStep = CourantNumber * smoothingLength / soundSpeed;
+	int steps = std::max(1, (int)ceil(delta / maxStep));
+	float step = (float)(delta / steps);
+	for (int s = 0; s < steps; s++) {
+		buildCellList(particles, count);
+		computeDensity(count);
+		computeAcceleration(count);
+		// The rotor reaches angle at the end of delta
+		integrateFluid(particles, count, step, center, speed, angle - speed * step * (steps - 1 - s));
+	}
+	return steps;
+}
@@ -0,0 +1,36 @@
+#ifndef FLUID_HPP
+#define FLUID_HPP
+
+// Smoothed particle hydrodynamics : a liquid sample spun in a tube at the rim of the rotor, instead of the debris.
+// Weakly compressible : a cubic spline kernel for the density and the pressure gradient, the artificial viscosity
+// of Monaghan 1992, and a pressure proportional to the compression.
+// Neighbours are found through a cell list of cells of half the kernel size, rebuilt every step, and the particles
+// are gathered in cell order so that the neighbour loops read contiguous memory.
+//
+// The tube is a box of square section along the radius, its bottom on the rim, turning with the rotor.
+// Before the start the liquid turns with it as a rigid body, then it is simulated in the inertial frame :
+// the walls hold it and the centrifugal pressure builds against the bottom.
+// The liquid does not age and does not sleep, and works in float whatever the simulation precision.
+
+struct FluidParameters {
+	float restDensity; // kg/m^3
+	float viscosity; // Artificial viscosity alpha, also damps the noise of the pressure
+	float densityVariation; // Allowed relative compression, sets the speed of sound from the centrifugal pressure
+	float fillRatio; // Part of the tube filled with liquid
+};
+
+const FluidParameters defaultFluidParameters = { 1000.0f, 0.1f, 0.03f, 0.5f };
+
+// Lay the particles out as a block of liquid at the bottom of the tube of the rotor, at rest in the rotor frame.
+// The size of the particles follows from the size of the tube : the more particles, the finer the liquid.
+void initFluid(Particle* particles, int count, const FluidParameters& parameters, const glm::vec3& center, float radius, float speed, float angle);
+bool isFluidEnabled();
+void cleanupFluid();
+// Kernel support h, the particles are h / 2 apart at rest
+float getFluidSmoothingLength();
+
+// Advance the liquid by delta, in as many internal steps as the CFL condition requires. The rotor is at angle at
+// the end of delta, turning at speed (rad/s). Returns the number of internal steps.
+int stepFluid(Particle* particles, int count, double delta, const glm::vec3& center, float speed, float angle, bool started);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef FORCES_HPP
+#define FORCES_HPP
+
+#include <type_traits>
+
+// Force model of the integrator, composed at compile time : the step kernel is instantiated for the active terms only,
+// so a term left out costs nothing, not even a multiplication by a zero coefficient.
+
+// Everything the step needs from the rotor, the same for all the particles of a group : computed once per step
+struct RotorStep {
+	glm::vec3 rimPosition; // Where the particles sit before the boom
+	glm::vec3 rimSpeed; // Their speed, also the reference of the drag
+};
+
+inline RotorStep makeRotorStep(const glm::vec3& center, float radius, float speed, float angle) {
+	RotorStep rotor;
+	rotor.rimPosition = center + glm::vec3(radius*sin(angle), radius*cos(angle), 0);
+	rotor.rimSpeed = speed * radius * glm::vec3(cos(angle), -sin(angle), 0);
+	return rotor;
+}
+
+// ********** Force terms **********
+// A term gives the acceleration of a unit mass particle. usesRelativeSpeed asks the kernel for |speed - rimSpeed|,
+// which is only computed if one of the active terms needs it.
+struct UniformGravity {
+	static const bool usesRelativeSpeed = false;
+	template <typename Vector>
+	static Vector acceleration(const Vector& speed, typename Vector::value_type relativeSpeed, float size) {
+		return Vector(0, 0, -gravityAcceleraion);
+	}
+};
+
+// f = kSv^2 : the acceleration is k |v - rimSpeed| / size along the speed
+struct QuadraticDrag {
+	static const bool usesRelativeSpeed = true;
+	template <typename Vector>
+	static Vector acceleration(const Vector& speed, typename Vector::value_type relativeSpeed, float size) {
+		return (typename Vector::value_type)(frictionCoefficient * relativeSpeed / size) * speed;
+	}
+};
+// ********** Force terms **********
+
+// Sum of the terms. One term returns its own acceleration, without adding a zero vector.
+template <typename... Terms>
+struct ForceModel;
+
+template <typename Term>
+struct ForceModel<Term> {
+	static const bool usesRelativeSpeed = Term::usesRelativeSpeed;
+	template <typename Vector>
+	static Vector acceleration(const Vector& speed, typename Vector::value_type relativeSpeed, float size) {
+		return Term::acceleration(speed, relativeSpeed, size);
+	}
+};
+
+template <typename Term, typename... Rest>
+struct ForceModel<Term, Rest...> {
+	static const bool usesRelativeSpeed = Term::usesRelativeSpeed || ForceModel<Rest...>::usesRelativeSpeed;
+	template <typename Vector>
+	static Vector acceleration(const Vector& speed, typename Vector::value_type relativeSpeed, float size) {
+		return Term::acceleration(speed, relativeSpeed, size) + ForceModel<Rest...>::acceleration(speed, relativeSpeed, size);
+	}
+};
+
+// The model of the simulation : the drag is only compiled in if its coefficient is not zero
+typedef std::conditional<frictionCoefficient != 0.0f,
+	ForceModel<UniformGravity, QuadraticDrag>,
+	ForceModel<UniformGravity> >::type ActiveForces;
+
+// One Euler step of a particle under Forces (life is handled by the caller)
+template <typename Forces, typename Precision>
+inline void integrateParticle(BasicParticle<Precision>& p, typename Precision::Time delta, const RotorStep& rotor, bool started) {
+	typedef typename Precision::Position Position;
+	typedef typename Precision::Velocity Velocity;
+	typedef glm::tvec3<Position, glm::highp> PositionVector;
+	typedef glm::tvec3<Velocity, glm::highp> VelocityVector;
+
+	if (!started) {
+		p.speed = VelocityVector(rotor.rimSpeed);
+		p.pos = PositionVector(rotor.rimPosition);
+		return;
+	}
+
+	// Forces in the velocity precision, the position increment in the position precision
+	VelocityVector startSpeed = p.speed;
+	Velocity relativeSpeedValue = 0;
+	if (Forces::usesRelativeSpeed) {
+		VelocityVector relativeSpeed = startSpeed - VelocityVector(rotor.rimSpeed);
+		relativeSpeedValue = sqrt(relativeSpeed[0] * relativeSpeed[0] + relativeSpeed[1] * relativeSpeed[1] + relativeSpeed[2] * relativeSpeed[2]);
+	}
+	VelocityVector endSpeed = startSpeed + (Velocity)delta * Forces::acceleration(startSpeed, relativeSpeedValue, p.size);
+	p.speed = endSpeed;
+	p.pos += PositionVector(p.speed) * (Position)delta;
+}
+
+#endif
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+
+#include "governor.hpp"
+
+// Cumulative, each level is cheaper to draw than the previous one
+static const RenderQuality qualityLevels[] = {
+	{ 1.0f,    1.0f,  1, true },
+	{ 1.0f,    1.0f,  1, false },
+	{ 1.0f,    0.5f,  1, false },
+	{ 1.0f,    0.5f,  2, false },
+	{ 0.5f,    0.25f, 2, false },
+	{ 0.5f,    0.25f, 4, false },
+	{ 0.25f,   0.0f,  4, false },
+	{ 0.125f,  0.0f,  8, false },
+	{ 0.0625f, 0.0f,  8, false }
+};
+const int LevelCount = sizeof(qualityLevels) / sizeof(qualityLevels[0]);
+
+const int WindowFrames = 30; // Frames averaged before each decision
+const double SlowRatio = 1.1; // Over target * SlowRatio, the quality drops
+const double FastRatio = 0.7; // Under target * FastRatio, the quality may come back
+const int MinUpgradeHold = 2, MaxUpgradeHold = 32; // Fast windows in a row before a level up
+const int UpgradeTrialWindows = 4; // A level up followed by a slow window within this many windows did not hold
+
+static double targetFrameTime = 0.0; // 0 : governor off
+static std::atomic<int> qualityLevel(0); // Written by the GL thread, read by the simulation thread
+static double windowTime = 0.0;
+static int windowFrames = 0;
+static int fastWindows = 0;
+static int upgradeHold = MinUpgradeHold;
+static int windowsSinceUpgrade = -1; // -1 : no level up on trial
+
+void initGovernor(double targetFrameRate) {
+	targetFrameTime = targetFrameRate > 0.0 ? 1.0 / targetFrameRate : 0.0;
+	qualityLevel = 0;
+	windowTime = 0.0;
+	windowFrames = 0;
+	fastWindows = 0;
+	upgradeHold = MinUpgradeHold;
+	windowsSinceUpgrade = -1;
+}
+
+bool isGovernorEnabled() {
+	return targetFrameTime > 0.0;
+}
+
+static void setQualityLevel(int level, double average) {
+	qualityLevel = level;
+	const RenderQuality& quality = qualityLevels[level]; // shortcut
+	printf("Quality level %d/%d : %g of the particles, %g of the trails, sort every %d frames, MSAA %s (%.1f ms per frame, target %.1f ms)\n",
+		level, LevelCount - 1, quality.subsample, quality.trailFraction, quality.sortInterval, quality.multisample ? "on" : "off",
+		average * 1000.0, targetFrameTime * 1000.0);
+}
+
+void updateGovernor(double frameSeconds) {
+	if (targetFrameTime <= 0.0) return;
+	// A single hitch (a window move, a texture load) must not drop the quality on its own
+	windowTime += std::min(frameSeconds, 4.0 * targetFrameTime);
+	if (++windowFrames < WindowFrames) return;
+	double average = windowTime / windowFrames;
+	windowTime = 0.0;
+	windowFrames = 0;
+
+	int level = qualityLevel;
+	if (average > targetFrameTime * SlowRatio) {
+		fastWindows = 0;
+		// The level up did not hold : wait longer before the next one, so that the quality does not oscillate
+		if (windowsSinceUpgrade >= 0) upgradeHold = std::min(upgradeHold * 2, MaxUpgradeHold);
+		windowsSinceUpgrade = -1;
+		if (level < LevelCount - 1) setQualityLevel(level + 1, average);
+		return;
+	}
+	if (windowsSinceUpgrade >= 0 && ++windowsSinceUpgrade >= UpgradeTrialWindows) {
+		// It held : the scene got lighter, the next level up may come sooner
+		upgradeHold = std::max(upgradeHold / 2, MinUpgradeHold);
+		windowsSinceUpgrade = -1;
+	}
+	if (average < targetFrameTime * FastRatio && level > 0) {
+		if (++fastWindows >= upgradeHold) {
+			fastWindows = 0;
+			windowsSinceUpgrade = 0;
+			setQualityLevel(level - 1, average);
+		}
+	}
+	else fastWindows = 0;
+}
+
+RenderQuality getRenderQuality() {
+	return qualityLevels[qualityLevel];
+}
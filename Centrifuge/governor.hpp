@@ -0,0 +1,30 @@
+#ifndef GOVERNOR_HPP
+#define GOVERNOR_HPP
+
+// Adaptive quality : holds a target frame rate on scenes too big for the machine, by drawing less of them.
+// The frame time is averaged over the last frames, the quality drops one level when it is over the target and
+// comes back slowly once it is well below it. Only the drawing is degraded, every particle is still simulated.
+// The levels, from the cheapest change to the most visible one :
+//   - no multisampling
+//   - shorter trails : only the newest samples are drawn
+//   - back to front sort once every few frames, the particles are drawn in a slightly stale order in between
+//   - a fraction of the particles, picked by ID like the distance based thinning (see culling.hpp)
+// The GPU simulation only gets the multisampling, it has no sort, no fill and no trails.
+
+struct RenderQuality {
+	float subsample; // Fraction of the particles drawn, their alpha is scaled by the inverse
+	float trailFraction; // Fraction of the trail samples drawn, newest first
+	int sortInterval; // Frames between two back to front sorts
+	bool multisample;
+};
+
+// targetFrameRate : frames per second to hold. The frame time is measured from swap to swap, so the
+// vertical sync must be off for the quality to come back : a synchronized frame never looks fast.
+void initGovernor(double targetFrameRate);
+bool isGovernorEnabled();
+// GL thread, once per frame : seconds since the previous frame
+void updateGovernor(double frameSeconds);
+// Current quality, from any thread. Full quality if the governor is off.
+RenderQuality getRenderQuality();
+
+#endif
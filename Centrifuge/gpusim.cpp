@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "shader.hpp"
+#include "controls.hpp"
+#include "simulation.hpp"
+#include "gpusim.hpp"
+
+static GLuint simulateProgramID = 0;
+static GLuint particleStateBuffers[2]; // Ping-pong : one is read while the other one is written
+static GLuint simulateVertexArrays[2]; // One vertex array per source buffer
+static GLuint boomKickBuffer;
+static int frontBuffer = 0; // Index of the buffer holding the last step
+static int gpuParticlesCount = 0;
+
+static GLint DeltaID, RadiusID, AngleID, CentrifugeSpeedID, GravityID, FrictionID, StartedID, BoomID, MarkerIndexID;
+
+bool initGpuSimulation(const Particle* particles, const glm::vec3* kicks, int count) {
+
+	const char* varyings[] = { "outXyzs", "outSpeedLife" };
+	simulateProgramID = LoadTransformFeedbackShader("ParticleSimulate.vertexshader", varyings, 2);
+	if (simulateProgramID == 0) {
+		fprintf(stderr, "Failed to build the GPU simulation program\n");
+		return false;
+	}
+
+	DeltaID = glGetUniformLocation(simulateProgramID, "delta");
+	RadiusID = glGetUniformLocation(simulateProgramID, "radius");
+	AngleID = glGetUniformLocation(simulateProgramID, "angle");
+	CentrifugeSpeedID = glGetUniformLocation(simulateProgramID, "centrifugeSpeed");
+	GravityID = glGetUniformLocation(simulateProgramID, "gravityAcceleration");
+	FrictionID = glGetUniformLocation(simulateProgramID, "frictionCoefficient");
+	StartedID = glGetUniformLocation(simulateProgramID, "started");
+	BoomID = glGetUniformLocation(simulateProgramID, "boom");
+	MarkerIndexID = glGetUniformLocation(simulateProgramID, "markerIndex");
+
+	// Constant parameters are set once
+	glUseProgram(simulateProgramID);
+	glUniform1f(CentrifugeSpeedID, centrifugeSpeed);
+	glUniform1f(GravityID, gravityAcceleraion);
+	glUniform1f(FrictionID, frictionCoefficient);
+	glUniform1i(MarkerIndexID, count - 1);
+
+	// The buffers are laid out in ID order, like the kicks and the marker index, whatever the order of the container
+	std::vector<GpuParticle> state(count);
+	for (int i = 0; i < count; i++) {
+		const Particle& p = particles[i]; // shortcut
+		state[p.id].xyzs = glm::vec4(p.pos, p.size);
+		state[p.id].speedLife = glm::vec4(p.speed, p.life);
+	}
+	gpuParticlesCount = count;
+	frontBuffer = 0;
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+
+	glGenBuffers(1, &boomKickBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, boomKickBuffer);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec3), kicks, GL_STATIC_DRAW);
+
+	glGenBuffers(2, particleStateBuffers);
+	glGenVertexArrays(2, simulateVertexArrays);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[i]);
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(GpuParticle), &state[0], GL_DYNAMIC_COPY);
+
+		glBindVertexArray(simulateVertexArrays[i]);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GpuParticle), (void*)sizeof(glm::vec4));
+		glEnableVertexAttribArray(2);
+		glBindBuffer(GL_ARRAY_BUFFER, boomKickBuffer);
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	}
+
+	glBindVertexArray(previousVertexArray);
+	return true;
+}
+
+void stepGpuSimulation(float delta, float radius, float angle, bool started, bool boom) {
+
+	glUseProgram(simulateProgramID);
+	glUniform1f(DeltaID, delta);
+	glUniform1f(RadiusID, radius);
+	glUniform1f(AngleID, angle);
+	glUniform1i(StartedID, started ? 1 : 0);
+	glUniform1i(BoomID, boom ? 1 : 0);
+
+	GLint previousVertexArray;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+
+	// Nothing is drawn : the vertex shader output goes straight into the back buffer
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(simulateVertexArrays[frontBuffer]);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, particleStateBuffers[1 - frontBuffer]);
+
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, gpuParticlesCount);
+	glEndTransformFeedback();
+
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glDisable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(previousVertexArray);
+
+	frontBuffer = 1 - frontBuffer;
+}
+
+GLuint getGpuParticleBuffer() {
+	return particleStateBuffers[frontBuffer];
+}
+
+void readGpuParticles(Particle* particles, int count) {
+	std::vector<GpuParticle> state(count);
+	glBindBuffer(GL_ARRAY_BUFFER, particleStateBuffers[frontBuffer]);
+	glGetBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(GpuParticle), &state[0]);
+
+	for (int i = 0; i < count; i++) {
+		Particle& p = particles[i]; // shortcut
+		p.pos = glm::vec3(state[i].xyzs);
+		p.size = state[i].xyzs.w;
+		p.speed = glm::vec3(state[i].speedLife);
+		p.life = state[i].speedLife.w;
+		p.id = i; // The buffers are in ID order and never reordered
+	}
+}
+
+void cleanupGpuSimulation() {
+	glDeleteBuffers(2, particleStateBuffers);
+	glDeleteBuffers(1, &boomKickBuffer);
+	glDeleteVertexArrays(2, simulateVertexArrays);
+	glDeleteProgram(simulateProgramID);
+	simulateProgramID = 0;
+	gpuParticlesCount = 0;
+}
+
+bool validateGpuSimulation(int steps, float delta, float tolerance) {
+
+	float radius = getCentrifugeRadius();
+	float angle = getCentrifugeAngle();
+
+	// The CPU engine runs on a private copy so the shared container is left untouched
+	std::vector<Particle> cpuParticles(ParticlesContainer, ParticlesContainer + MaxParticles);
+	std::vector<Particle> gpuParticles(cpuParticles);
+
+	if (!initGpuSimulation(&cpuParticles[0], BoomKicks, MaxParticles)) return false;
+
+	// Spin for a quarter of the run, then boom
+	int boomStep = steps / 4;
+	for (int s = 0; s < steps; s++) {
+		angle += centrifugeSpeed * delta;
+		bool started = s >= boomStep;
+		bool boom = s == boomStep;
+
+		for (int i = 0; i < MaxParticles; i++) {
+			Particle& p = cpuParticles[i]; // shortcut
+			if (boom) p.speed += BoomKicks[p.id];
+			if (p.life > 0.0f) {
+				p.life -= delta;
+				if (p.life > 0.0f && (int)p.id != MaxParticles - 1) {
+					stepParticle(p, delta, radius, angle, started);
+				}
+			}
+		}
+
+		stepGpuSimulation(delta, radius, angle, started, boom);
+	}
+
+	readGpuParticles(&gpuParticles[0], MaxParticles);
+	cleanupGpuSimulation();
+
+	float maxPositionError = 0.0f, maxSpeedError = 0.0f;
+	for (int i = 0; i < MaxParticles; i++) {
+		const Particle& c = cpuParticles[i];
+		const Particle& g = gpuParticles[c.id]; // The GPU state is read back in ID order
+		if (c.life <= 0.0f) continue;
+		maxPositionError = max(maxPositionError, (float)length(c.pos - g.pos) / max(1.0f, (float)length(c.pos)));
+		maxSpeedError = max(maxSpeedError, (float)length(c.speed - g.speed) / max(1.0f, (float)length(c.speed)));
+	}
+
+	bool passed = maxPositionError <= tolerance && maxSpeedError <= tolerance;
+	printf("GPU simulation %s : %d steps, max relative position error %g, max relative speed error %g (tolerance %g)\n",
+		passed ? "passed" : "FAILED", steps, maxPositionError, maxSpeedError, tolerance);
+	printf("Renderer : %s\n", (const char*)glGetString(GL_RENDERER));
+	return passed;
+}
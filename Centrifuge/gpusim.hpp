@@ -0,0 +1,23 @@
+#ifndef GPUSIM_HPP
+#define GPUSIM_HPP
+
+// GPU representation of a particle, as laid out in the transform feedback buffers
+struct GpuParticle {
+	glm::vec4 xyzs; // Position and size. The size is 0 once the particle is dead.
+	glm::vec4 speedLife; // Speed and remaining life
+};
+
+// Compile the simulation program and upload the initial state of the particles, in ID order (kicks indexed by ID)
+bool initGpuSimulation(const Particle* particles, const glm::vec3* kicks, int count);
+// Advance every particle by one step on the GPU, the CPU never touches the particle state
+void stepGpuSimulation(float delta, float radius, float angle, bool started, bool boom);
+// Buffer holding the state of the last step. Bind it with a stride of sizeof(GpuParticle).
+GLuint getGpuParticleBuffer();
+// Read the state of the last step back into a Particle array, in ID order (debug and validation only)
+void readGpuParticles(Particle* particles, int count);
+void cleanupGpuSimulation();
+
+// Run the CPU and the GPU engines side by side and compare the results
+bool validateGpuSimulation(int steps, float delta, float tolerance);
+
+#endif
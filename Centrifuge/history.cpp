@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "scene.hpp"
+#include "history.hpp"
+
+struct Keyframe {
+	long long step;
+	HistoryState state;
+	float angles[MaxGroups];
+	std::vector<Particle> particles;
+};
+
+static std::vector<Keyframe> keyframes; // Ring, oldest at keyframeFirst
+static int keyframeFirst = 0;
+static int keyframeCount = 0;
+static int keyframeInterval = 1;
+static std::deque<HistoryEvent> events; // Since the oldest keyframe, in order
+
+void initHistory(int count, int interval) {
+	keyframes.clear();
+	keyframes.resize(count > 0 ? count : 0);
+	for (size_t k = 0; k < keyframes.size(); k++) {
+		keyframes[k].particles.resize(MaxParticles); // Allocated up front, recording never allocates
+	}
+	keyframeFirst = 0;
+	keyframeCount = 0;
+	keyframeInterval = interval > 0 ? interval : 1;
+	events.clear();
+	if (count > 0) {
+		printf("History : %d keyframes every %d steps, %.1f MB\n", count, keyframeInterval,
+			count * MaxParticles * sizeof(Particle) / (1024.0 * 1024.0));
+	}
+}
+
+void cleanupHistory() {
+	keyframes.clear();
+	keyframeCount = 0;
+	events.clear();
+}
+
+bool isHistoryEnabled() {
+	return !keyframes.empty();
+}
+
+// k-th keyframe from the oldest
+static Keyframe& getKeyframe(int k) {
+	return keyframes[(keyframeFirst + k) % keyframes.size()];
+}
+
+void recordHistory(long long step, const HistoryState& state, bool force) {
+	if (keyframes.empty()) return;
+
+	Keyframe* keyframe = NULL;
+	if (keyframeCount > 0) {
+		Keyframe& last = getKeyframe(keyframeCount - 1); // shortcut
+		bool inputsChanged = last.state.started != state.started || last.state.boomed != state.boomed;
+		if (last.step == step) {
+			if (!inputsChanged && !force) return;
+			keyframe = &last; // Same step, new inputs : overwrite
+		} else if (step - last.step < keyframeInterval && !inputsChanged && !force) {
+			return;
+		}
+	}
+	if (keyframe == NULL) {
+		if (keyframeCount == (int)keyframes.size()) {
+			// Full : the oldest keyframe makes room, and the events before the new oldest one go with it
+			keyframeFirst = (keyframeFirst + 1) % keyframes.size();
+			keyframeCount--;
+			long long oldest = keyframeCount > 0 ? getKeyframe(0).step : step;
+			while (!events.empty() && events.front().step <= oldest) events.pop_front();
+		}
+		keyframe = &getKeyframe(keyframeCount);
+		keyframeCount++;
+	}
+
+	keyframe->step = step;
+	keyframe->state = state;
+	getSceneAngles(keyframe->angles);
+	memcpy(&keyframe->particles[0], ParticlesContainer, MaxParticles * sizeof(Particle));
+}
+
+long long restoreKeyframe(long long step, HistoryState& state) {
+	if (keyframeCount == 0) return -1;
+
+	int k = keyframeCount - 1;
+	while (k > 0 && getKeyframe(k).step > step) k--;
+	const Keyframe& keyframe = getKeyframe(k); // shortcut
+	state = keyframe.state;
+	setSceneAngles(keyframe.angles);
+	memcpy(ParticlesContainer, &keyframe.particles[0], MaxParticles * sizeof(Particle));
+	return keyframe.step;
+}
+
+long long getOldestHistoryStep() {
+	return keyframeCount > 0 ? getKeyframe(0).step : -1;
+}
+
+void truncateHistory(long long step) {
+	while (keyframeCount > 0 && getKeyframe(keyframeCount - 1).step > step) keyframeCount--;
+	while (!events.empty() && events.back().step > step) events.pop_back();
+}
+
+void recordHistoryEvent(long long step, HistoryEventType type, const glm::vec3& cameraPosition) {
+	if (keyframes.empty()) return;
+	HistoryEvent event = { step, type, cameraPosition };
+	if (!events.empty() && events.back().step == step && events.back().type == type) {
+		events.back() = event;
+		return;
+	}
+	events.push_back(event);
+}
+
+void getHistoryEvents(long long from, long long to, std::vector<HistoryEvent>& found) {
+	found.clear();
+	for (size_t e = 0; e < events.size(); e++) {
+		if (events[e].step > from && events[e].step <= to) found.push_back(events[e]);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+// Bounded history of the CPU simulation : a ring of keyframes, one every interval substeps.
+// The substeps are fixed and deterministic, so any step since the oldest keyframe is rebuilt
+// by restoring the keyframe before it and re-simulating at most interval substeps.
+// What changes the particles between two substeps without being an input is logged as events,
+// replayed at the same steps by the re-simulation.
+
+// Inputs that change the stepping, saved with each keyframe
+struct HistoryState {
+	bool started;
+	bool boomed;
+};
+
+enum HistoryEventType {
+	HistorySort, // sortScene() : the order of the particles changes the sums of the fluid
+	HistoryWake  // W : every sleeping particle woken, see sleep.hpp
+};
+
+struct HistoryEvent {
+	long long step; // Substeps integrated when it happened
+	HistoryEventType type;
+	glm::vec3 cameraPosition; // Sort : the camera it sorted from, the order only depends on it and the particles
+};
+
+// keyframeCount keyframes of the whole ParticlesContainer, 0 disables the history
+void initHistory(int keyframeCount, int interval);
+void cleanupHistory();
+bool isHistoryEnabled();
+
+// Called before each live substep. Stores a keyframe every interval substeps, and whenever the inputs changed
+// since the last keyframe, so that they are constant between two keyframes. force : store one anyway, e.g.
+// when the run resumes from the past, after events that were not logged.
+void recordHistory(long long step, const HistoryState& state, bool force = false);
+// Restore the particles and the rotors of the latest keyframe at or before step, returns the step of that keyframe,
+// -1 if the history is empty. A step older than the history gets the oldest keyframe.
+long long restoreKeyframe(long long step, HistoryState& state);
+long long getOldestHistoryStep();
+// Forget the keyframes and the events after step : the simulation resumes from the past and writes a new future
+void truncateHistory(long long step);
+
+// Log an event at step, the latest step of the history : what happens in the past, while scrubbing, only matters
+// if the run resumes from there, and that stores a keyframe. It replaces the previous event if that one has the
+// same type and step : a paused run sorts every frame and only the last order matters, a second wake does nothing.
+void recordHistoryEvent(long long step, HistoryEventType type, const glm::vec3& cameraPosition = glm::vec3(0.0f));
+// The events of (from, to], in the order they happened. The keyframe of step from already holds the ones at from.
+void getHistoryEvents(long long from, long long to, std::vector<HistoryEvent>& events);
+
+#endif
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <map>
+#include <algorithm>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "culling.hpp"
+#include "parallel.hpp"
+#include "packing.hpp"
+
+// Palette key of a particle. With coarse set, colors are reduced to 4 bits per channel.
+static unsigned long long paletteKey(const Particle& p, bool coarse) {
+	unsigned char mask = coarse ? 0xF0 : 0xFF;
+	unsigned int color = (p.r & mask) | ((p.g & mask) << 8) | ((p.b & mask) << 16) | ((unsigned int)(p.a & mask) << 24);
+	unsigned int size;
+	memcpy(&size, &p.size, sizeof(size));
+	return ((unsigned long long)size << 32) | color;
+}
+
+void buildAttributeTable(const Particle* particles, int count, glm::vec4* table) {
+	for (int i = 0; i < count; i++) {
+		const Particle& p = particles[i]; // shortcut
+		table[2 * p.id + 0] = glm::vec4(p.r, p.g, p.b, p.a) / 255.0f;
+		table[2 * p.id + 1] = glm::vec4(p.size, 0, 0, 0);
+	}
+}
+
+// The chunks of a parallel fill write their survivors at the start of their own range,
+// this packs them together in order. Returns the total number of items.
+template <typename T>
+static int compactChunks(T* items, int count, const std::vector<int>& chunkCounts) {
+	int chunks = (int)chunkCounts.size();
+	int total = 0;
+	for (int c = 0; c < chunks; c++) {
+		int begin = getChunkBegin(count, chunks, c);
+		if (begin != total) memmove(items + total, items + begin, chunkCounts[c] * sizeof(T));
+		total += chunkCounts[c];
+	}
+	return total;
+}
+
+int fillInstances(const Particle* particles, int count, ParticleInstance* instances, const ViewCull* cull) {
+	std::vector<int> chunkCounts(getChunkCount(count));
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		int instanceCount = begin;
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			if (cull != NULL && !isParticleVisible(*cull, p)) continue;
+			instances[instanceCount].x = p.pos.x;
+			instances[instanceCount].y = p.pos.y;
+			instances[instanceCount].z = p.pos.z;
+			instances[instanceCount].id = p.id;
+			instanceCount++;
+		}
+		chunkCounts[chunk] = instanceCount - begin;
+	});
+	return compactChunks(instances, count, chunkCounts);
+}
+
+int buildParticlePalette(Particle* particles, int count, glm::vec4* palette) {
+
+	// Most scenes only have a handful of sizes and colors. If there are too many distinct
+	// ones, the colors are quantized so that the index still fits in 16 bits.
+	std::map<unsigned long long, int> entries;
+	bool coarse = false;
+	for (int i = 0; i < count; i++) {
+		entries.insert(std::make_pair(paletteKey(particles[i], coarse), (int)entries.size()));
+		if ((int)entries.size() > MaxPaletteEntries && !coarse) {
+			printf("More than %d particle colors, quantizing the palette\n", MaxPaletteEntries);
+			entries.clear();
+			coarse = true;
+			i = -1;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		Particle& p = particles[i]; // shortcut
+		int index = entries[paletteKey(p, coarse)];
+		if (index >= MaxPaletteEntries) index = MaxPaletteEntries - 1;
+		p.palette = (unsigned short)index;
+		palette[2 * index + 0] = glm::vec4(p.r, p.g, p.b, p.a) / 255.0f;
+		palette[2 * index + 1] = glm::vec4(p.size, 0, 0, 0);
+	}
+
+	return min((int)entries.size(), MaxPaletteEntries);
+}
+
+void computePackingBounds(const Particle* particles, int count, const ViewCull* cull, glm::vec3& origin, glm::vec3& scale) {
+
+	// Bounding box of the particles that will be drawn, one per chunk
+	int chunks = getChunkCount(count);
+	std::vector<glm::vec3> chunkMin(chunks, glm::vec3(1e30f)), chunkMax(chunks, glm::vec3(-1e30f));
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		glm::vec3 minPos(1e30f), maxPos(-1e30f);
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			if (cull != NULL && !isParticleVisible(*cull, p)) continue;
+			minPos = min(minPos, glm::vec3(p.pos));
+			maxPos = max(maxPos, glm::vec3(p.pos));
+		}
+		chunkMin[chunk] = minPos;
+		chunkMax[chunk] = maxPos;
+	});
+	glm::vec3 minPos(1e30f), maxPos(-1e30f);
+	for (int c = 0; c < chunks; c++) {
+		minPos = min(minPos, chunkMin[c]);
+		maxPos = max(maxPos, chunkMax[c]);
+	}
+	if (minPos.x > maxPos.x) minPos = maxPos = glm::vec3(0.0f); // Nothing to draw
+
+	origin = (minPos + maxPos) * 0.5f;
+	scale = max((maxPos - minPos) * 0.5f, glm::vec3(1e-6f)); // Avoid a division by zero before the boom
+}
+
+int quantizeParticles(const Particle* particles, int count, PackedInstance* packed, const glm::vec3& origin, const glm::vec3& scale, const ViewCull* cull) {
+	glm::vec3 invScale = 32767.0f / scale;
+	std::vector<int> chunkCounts(getChunkCount(count));
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		int packedCount = begin;
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			if (cull != NULL && !isParticleVisible(*cull, p)) continue;
+			glm::vec3 q = clamp(glm::round((glm::vec3(p.pos) - origin) * invScale), glm::vec3(-32767.0f), glm::vec3(32767.0f));
+			packed[packedCount].x = (short)q.x;
+			packed[packedCount].y = (short)q.y;
+			packed[packedCount].z = (short)q.z;
+			packed[packedCount].palette = p.palette;
+			packedCount++;
+		}
+		chunkCounts[chunk] = packedCount - begin;
+	});
+	return compactChunks(packed, count, chunkCounts);
+}
+
+int packParticles(const Particle* particles, int count, PackedInstance* packed, glm::vec3& origin, glm::vec3& scale, const ViewCull* cull) {
+	computePackingBounds(particles, count, cull, origin, scale);
+	return quantizeParticles(particles, count, packed, origin, scale, cull);
+}
+
+// Sort keys : the squared distance is positive, so its bits sort like it. They are inverted to put the farthest first,
+// the index below them keeps the order stable. Sorting 8-byte keys costs much less than moving the instances.
+static std::vector<unsigned long long> orderKeys;
+
+template <typename Position>
+static void sortOrder(int count, const glm::vec3& CameraPosition, unsigned int* order, const Position& position) {
+	orderKeys.resize(count);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			glm::vec3 d = position(i) - CameraPosition;
+			float distance2 = dot(d, d);
+			unsigned int bits;
+			memcpy(&bits, &distance2, sizeof(bits));
+			orderKeys[i] = ((unsigned long long)~bits << 32) | (unsigned int)i;
+		}
+	});
+	std::sort(orderKeys.begin(), orderKeys.end());
+	for (int i = 0; i < count; i++) order[i] = (unsigned int)orderKeys[i];
+}
+
+void sortInstanceOrder(const ParticleInstance* instances, int count, const glm::vec3& CameraPosition, unsigned int* order) {
+	sortOrder(count, CameraPosition, order, [&](int i) {
+		return glm::vec3(instances[i].x, instances[i].y, instances[i].z);
+	});
+}
+
+void sortPackedOrder(const PackedInstance* packed, int count, const glm::vec3& origin, const glm::vec3& scale, const glm::vec3& CameraPosition, unsigned int* order) {
+	glm::vec3 unit = scale / 32767.0f;
+	sortOrder(count, CameraPosition, order, [&](int i) {
+		return origin + glm::vec3(packed[i].x, packed[i].y, packed[i].z) * unit;
+	});
+}
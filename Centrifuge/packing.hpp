@@ -0,0 +1,39 @@
+#ifndef PACKING_HPP
+#define PACKING_HPP
+
+// Per-instance format : world space position and the stable ID of the particle, which indexes its
+// static color and size in the attribute table uploaded once at init.
+struct ParticleInstance {
+	float x, y, z;
+	unsigned int id;
+};
+
+// Compact per-instance format : 8 bytes instead of the 16 bytes of ParticleInstance.
+// The position is 16-bit fixed point relative to a per-frame origin/scale, size and color live in a palette.
+struct PackedInstance {
+	short x, y, z; // (pos - origin) / scale, normalized to [-32767, 32767]
+	unsigned short palette; // Index in the color/size palette
+};
+
+const int MaxPaletteEntries = 65536;
+
+// Fill the attribute table indexed by particle ID, 2 texels per particle : color, (size, 0, 0, 0)
+void buildAttributeTable(const Particle* particles, int count, glm::vec4* table);
+// Copy the live particles that pass the culling (if not NULL), in order. Returns the number of instances written.
+int fillInstances(const Particle* particles, int count, ParticleInstance* instances, const ViewCull* cull);
+
+// Assign a palette index to every particle, and fill the palette with 2 texels per entry : color, (size, 0, 0, 0).
+// Returns the number of palette entries.
+int buildParticlePalette(Particle* particles, int count, glm::vec4* palette);
+// Quantize the live particles that pass the culling (if not NULL), in order. Returns the number of instances written.
+int packParticles(const Particle* particles, int count, PackedInstance* packed, glm::vec3& origin, glm::vec3& scale, const ViewCull* cull);
+// The two halves of packParticles(), to share one origin/scale between several ranges of particles
+void computePackingBounds(const Particle* particles, int count, const ViewCull* cull, glm::vec3& origin, glm::vec3& scale);
+int quantizeParticles(const Particle* particles, int count, PackedInstance* packed, const glm::vec3& origin, const glm::vec3& scale, const ViewCull* cull);
+
+// Back to front order of the instances for another camera, so that a second view draws the same uploaded instances :
+// order receives the indices of the instances, the farthest from CameraPosition first. The instances do not move.
+void sortInstanceOrder(const ParticleInstance* instances, int count, const glm::vec3& CameraPosition, unsigned int* order);
+void sortPackedOrder(const PackedInstance* packed, int count, const glm::vec3& origin, const glm::vec3& scale, const glm::vec3& CameraPosition, unsigned int* order);
+
+#endif
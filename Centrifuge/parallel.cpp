@@ -0,0 +1,153 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <vector>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+static int threadCount = 0; // 0 : not set yet, use the hardware threads
+
+// ********** Worker pool **********
+// threadCount - 1 workers sleep until a parallelFor() hands them a job, and take its chunks along with the calling thread.
+// One job at a time : the callers of other threads wait for the pool. The pool is allocated once and never freed,
+// the workers are not joined at exit : a library cannot join threads while it is being unloaded.
+struct WorkerPool {
+	std::vector<std::thread> workers;
+	std::mutex dispatchMutex; // Held by the caller for the whole job, and by setThreadCount()
+	std::mutex mutex; // The job below
+	std::condition_variable wake, done;
+	// Current job
+	const std::function<void(int, int, int)>* body = NULL;
+	int count = 0, chunks = 0;
+	std::atomic<int> nextChunk{ 0 };
+	int finishedChunks = 0; // Claimed and run, including the ones that threw
+	int busyWorkers = 0; // Between taking the job and reporting their chunks : the next job waits for them
+	unsigned long long generation = 0; // Incremented with each job
+	std::exception_ptr failure; // First exception thrown by a chunk, rethrown by the caller
+	bool stopping = false;
+};
+
+static WorkerPool& getPool() {
+	static WorkerPool* pool = new WorkerPool;
+	return *pool;
+}
+
+static thread_local bool insideJob = false; // Set on the workers and on a caller during its job : a parallelFor() from a chunk runs on its thread
+
+// Run the chunks left in the job, returns how many were claimed
+static int runChunks(WorkerPool& pool, const std::function<void(int, int, int)>& body, int count, int chunks) {
+	int claimed = 0;
+	for (int c = pool.nextChunk++; c < chunks; c = pool.nextChunk++) {
+		claimed++;
+		try {
+			body(getChunkBegin(count, chunks, c), getChunkBegin(count, chunks, c + 1), c);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(pool.mutex);
+			if (!pool.failure) pool.failure = std::current_exception();
+		}
+	}
+	return claimed;
+}
+
+static void runWorker(WorkerPool& pool) {
+	insideJob = true;
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	unsigned long long seen = pool.generation; // A job published before the start goes on without this worker
+	for (;;) {
+		pool.wake.wait(lock, [&] { return pool.stopping || pool.generation != seen; });
+		if (pool.stopping) return;
+		seen = pool.generation;
+		// The job is copied under the lock, the next one is only set up once every busy worker reported
+		const std::function<void(int, int, int)>& body = *pool.body;
+		int count = pool.count, chunks = pool.chunks;
+		pool.busyWorkers++;
+		lock.unlock();
+		int claimed = runChunks(pool, body, count, chunks);
+		lock.lock();
+		pool.finishedChunks += claimed;
+		pool.busyWorkers--;
+		pool.done.notify_all();
+	}
+}
+
+// Under dispatchMutex
+static void stopWorkers(WorkerPool& pool) {
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		pool.stopping = true;
+	}
+	pool.wake.notify_all();
+	for (size_t i = 0; i < pool.workers.size(); i++) pool.workers[i].join();
+	pool.workers.clear();
+	pool.stopping = false;
+}
+
+// Under dispatchMutex
+static void startWorkers(WorkerPool& pool, int count) {
+	for (int i = 0; i < count; i++) pool.workers.push_back(std::thread(runWorker, std::ref(pool)));
+}
+// ********** Worker pool **********
+
+int getThreadCount() {
+	if (threadCount <= 0) {
+		threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+	return threadCount;
+}
+
+void setThreadCount(int count) {
+	WorkerPool& pool = getPool(); // shortcut
+	std::lock_guard<std::mutex> dispatch(pool.dispatchMutex);
+	threadCount = count;
+	// The workers follow on the next parallelFor()
+	if ((int)pool.workers.size() != getThreadCount() - 1) stopWorkers(pool);
+}
+
+int getChunkCount(int count, int minChunk) {
+	return std::max(1, std::min(getThreadCount(), count / minChunk));
+}
+
+int getChunkBegin(int count, int chunks, int chunk) {
+	return (int)((long long)count * chunk / chunks);
+}
+
+void parallelFor(int count, const std::function<void(int, int, int)>& body, int minChunk) {
+	int chunks = getChunkCount(count, minChunk);
+	if (chunks == 1 || insideJob) {
+		// Same chunks on this thread, the merges in chunk order give the same result
+		for (int c = 0; c < chunks; c++) body(getChunkBegin(count, chunks, c), getChunkBegin(count, chunks, c + 1), c);
+		return;
+	}
+
+	WorkerPool& pool = getPool(); // shortcut
+	std::lock_guard<std::mutex> dispatch(pool.dispatchMutex);
+	if (pool.workers.empty()) startWorkers(pool, getThreadCount() - 1);
+
+	std::unique_lock<std::mutex> lock(pool.mutex);
+	pool.done.wait(lock, [&] { return pool.busyWorkers == 0; }); // Late workers of the previous job
+	pool.body = &body;
+	pool.count = count;
+	pool.chunks = chunks;
+	pool.nextChunk = 0;
+	pool.finishedChunks = 0;
+	pool.failure = nullptr;
+	pool.generation++;
+	lock.unlock();
+	pool.wake.notify_all();
+
+	// The calling thread takes chunks as well
+	insideJob = true;
+	int claimed = runChunks(pool, body, count, chunks);
+	insideJob = false;
+	lock.lock();
+	pool.finishedChunks += claimed;
+	pool.done.wait(lock, [&] { return pool.finishedChunks == chunks; });
+	std::exception_ptr failure = pool.failure;
+	pool.failure = nullptr;
+	lock.unlock();
+	if (failure) std::rethrow_exception(failure);
+}
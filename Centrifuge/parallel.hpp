@@ -0,0 +1,25 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <functional>
+
+// Below this many items per chunk, splitting the work costs more than it saves
+const int MinParallelChunk = 4096;
+
+// Number of worker threads, defaults to the number of hardware threads. The calling thread counts as one :
+// the pool keeps count - 1 workers waiting for parallelFor(), restarted when the count changes.
+int getThreadCount();
+void setThreadCount(int count);
+
+// Number of chunks parallelFor() splits count items into, at least minChunk items each
+int getChunkCount(int count, int minChunk = MinParallelChunk);
+// First item of a chunk, chunk ranges are [getChunkBegin(c), getChunkBegin(c + 1))
+int getChunkBegin(int count, int chunks, int chunk);
+// Split [0, count) into contiguous chunks and run body(begin, end, chunk) on each of them in parallel.
+// Chunks are numbered in order, so per-chunk results can be merged in order afterwards.
+// minChunk is lower for heavy items, e.g. one spatial query each.
+// One call at a time uses the pool, the others wait for it. A call from a chunk runs its chunks on its own thread.
+// The first exception thrown by a chunk is rethrown once every chunk ran.
+void parallelFor(int count, const std::function<void(int, int, int)>& body, int minChunk = MinParallelChunk);
+
+#endif
@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "controls.hpp"
+#include "simulation.hpp"
+#include "gpusim.hpp"
+#include "culling.hpp"
+#include "packing.hpp"
+#include "scene.hpp"
+#include "trails.hpp"
+#include "pipeline.hpp"
+#include "timing.hpp"
+#include "diagnostics.hpp"
+#include "history.hpp"
+#include "density.hpp"
+#include "sleep.hpp"
+#include "fluid.hpp"
+#include "stream.hpp"
+#include "replay.hpp"
+#include "governor.hpp"
+
+// ********** Command queue **********
+const unsigned int CommandQueueSize = 1024; // Must be a power of two
+static Command commandQueue[CommandQueueSize];
+static std::atomic<unsigned int> commandHead(0); // Next command to read, only written by the consumer
+static std::atomic<unsigned int> commandTail(0); // Next slot to write, only written by the producer
+
+bool pushCommand(CommandType type, double x, double y) {
+	unsigned int tail = commandTail.load(std::memory_order_relaxed);
+	if (tail - commandHead.load(std::memory_order_acquire) == CommandQueueSize) {
+		return false;
+	}
+	Command& command = commandQueue[tail & (CommandQueueSize - 1)];
+	command.type = type;
+	command.x = x;
+	command.y = y;
+	commandTail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+static bool popCommand(Command& command) {
+	unsigned int head = commandHead.load(std::memory_order_relaxed);
+	if (head == commandTail.load(std::memory_order_acquire)) {
+		return false;
+	}
+	command = commandQueue[head & (CommandQueueSize - 1)];
+	commandHead.store(head + 1, std::memory_order_release);
+	return true;
+}
+// ********** Command queue **********
+
+static FrameOptions frameOptions;
+static RenderFrame frames[2]; // Double buffer : one is drawn while the other one is simulated
+static double lastTime;
+static bool startFlag = false; // Simulation start flag. If TRUE, simulation will begin
+static bool boomFlag = false;
+static double cursorX = 0.0, cursorY = 0.0;
+
+// Time warp : simulated seconds per real second, integrated in fixed substeps
+const double MinTimeWarp = 0.01, MaxTimeWarp = 1000.0;
+static double timeWarp;
+static double stepAccumulator = 0.0; // Simulated time not integrated yet, always < one substep after a frame on time
+static double droppedTime = 0.0; // Simulated time given up since the last lag report
+static double lagReportTime = 0.0;
+
+// Rewind and scrub, see history.hpp
+static bool pauseFlag = false;
+static long long simulationStep = 0; // Substeps integrated since the start
+static long long historyHead = 0; // Latest step reached, the limit of a forward scrub
+static double scrubOffset = 0.0; // Pending scrub, in simulated seconds
+
+static bool densityFlag = false; // Density view instead of the billboards, see density.hpp
+static bool splitFlag = false; // Lab and rotor views side by side
+static int framesSinceSort = 0; // The governor may sort only once every few frames
+
+// Recording, replay and camera path, see replay.hpp
+static double timeOrigin; // Time of initFrames(), the frame times of the scripts are relative to it
+static double lastPathTime = -1e30; // Time of the last frame that took the commands of the camera path
+static std::vector<Command> frameCommands; // Commands applied in this frame
+static int inputCommandCount = 0; // The first ones of frameCommands, the input recorded with the frame
+static int replaySubsteps = -1; // Substeps of the recorded frame being replayed, -1 : not replaying
+static std::atomic<bool> scriptFinished(false);
+
+// Conservation diagnostics, the reference is taken on the first step after the boom
+static PhysicsDiagnostics diagnosticsReference;
+static bool diagnosticsReferenceSet = false;
+static int diagnosticsStep = 0;
+static double diagnosticsTime = 0.0;
+static std::vector<Particle> gpuReadback;
+static std::vector<HistoryEvent> scrubEvents;
+
+void initFrames(const FrameOptions& options, double time) {
+	frameOptions = options;
+	timeWarp = std::max(MinTimeWarp, std::min(options.timeWarp, MaxTimeWarp));
+	densityFlag = options.density && !options.gpuSimulation;
+	splitFlag = options.split;
+	stepAccumulator = 0.0;
+	droppedTime = 0.0;
+	lagReportTime = time;
+	timeOrigin = time;
+	for (int i = 0; i < 2; i++) {
+		frames[i].instances = new ParticleInstance[MaxParticles];
+		frames[i].packed = new PackedInstance[MaxParticles];
+		frames[i].density = new float[DensityWidth * DensityHeight];
+		frames[i].rotorOrder = new unsigned int[MaxParticles];
+		frames[i].trailSample = isTrailsEnabled() ? new float[3 * MaxParticles] : NULL;
+		frames[i].split = false;
+		frames[i].densityView = false;
+		frames[i].trailSlot = -1;
+		frames[i].trailSamples = 0;
+		frames[i].count = 0;
+		frames[i].culled = false;
+		frames[i].subsample = 1.0f;
+	}
+	lastTime = time;
+}
+
+void cleanupFrames() {
+	for (int i = 0; i < 2; i++) {
+		delete[] frames[i].instances;
+		delete[] frames[i].packed;
+		delete[] frames[i].density;
+		delete[] frames[i].rotorOrder;
+		delete[] frames[i].trailSample;
+	}
+}
+
+static void applyCommand(const Command& command) {
+	switch (command.type) {
+	case CommandToggleStart:
+		startFlag = !startFlag;
+		break;
+	case CommandToggleNoninertial:
+		if (!splitFlag) setNoninertialFlag(!getNoninertialFlag()); // The split view already shows both
+		break;
+	case CommandToggleSplitView:
+		splitFlag = !splitFlag;
+		if (splitFlag) setNoninertialFlag(false); // The left half is the lab view
+		break;
+	case CommandRotate:
+		setRotateFlag(command.x != 0.0);
+		break;
+	case CommandMove:
+		setMoveFlag(command.x != 0.0);
+		break;
+	case CommandScroll:
+		AddScrollOffset(command.y);
+		break;
+	case CommandCursor:
+		cursorX = command.x;
+		cursorY = command.y;
+		break;
+	case CommandTogglePause:
+		pauseFlag = !pauseFlag;
+		break;
+	case CommandScrub:
+		scrubOffset += command.x;
+		break;
+	case CommandToggleDensity:
+		densityFlag = !densityFlag && !frameOptions.gpuSimulation;
+		break;
+	case CommandWakeParticles:
+		if (isSleepEnabled()) {
+			printf("%d particles woken\n", wakeAllParticles());
+			if (simulationStep == historyHead) recordHistoryEvent(simulationStep, HistoryWake);
+		}
+		break;
+	case CommandTimeWarp:
+		timeWarp = std::max(MinTimeWarp, std::min(timeWarp * command.x, MaxTimeWarp));
+		printf("Time warp %gx\n", timeWarp);
+		break;
+	}
+}
+
+// Apply the commands of this frame : the live ones, or the recorded ones during a replay, then the ones of the
+// camera path. Returns the time of the frame, the recorded one during a replay.
+static double applyCommands(double time) {
+	frameCommands.clear();
+	Command command;
+	while (popCommand(command)) frameCommands.push_back(command);
+	replaySubsteps = -1;
+	if (isInputReplaying()) {
+		// The live input is dropped. Past the end, the frames go on with the live time and no command.
+		double recordedTime;
+		if (replayInputFrame(recordedTime, replaySubsteps, frameCommands)) time = timeOrigin + recordedTime;
+		else scriptFinished = true;
+	}
+	// Only the input is recorded, with the frame once simulated : the camera path is given again to the replay
+	inputCommandCount = (int)frameCommands.size();
+	if (isCameraPathEnabled()) {
+		getCameraPathCommands(lastPathTime, time - timeOrigin, frameCommands);
+		lastPathTime = time - timeOrigin;
+		if (isCameraPathFinished(time - timeOrigin)) scriptFinished = true;
+	}
+	for (size_t i = 0; i < frameCommands.size(); i++) applyCommand(frameCommands[i]);
+	return time;
+}
+
+bool isScriptFinished() {
+	return scriptFinished;
+}
+
+// What else than gravity acts on the particles, NULL if they fall freely
+static const char* getNonGravityForces() {
+	if (frictionCoefficient != 0.0f) return "drag";
+	if (isFluidEnabled()) return "walls of the fluid tube";
+	if (isSleepEnabled()) return "floor of the sleeping region";
+	return NULL;
+}
+
+// Called after each step, only does something every diagnosticsInterval steps once the particles fly
+static void runDiagnostics(float delta) {
+	if (frameOptions.diagnosticsInterval <= 0) return;
+	if (!startFlag) {
+		diagnosticsReferenceSet = false;
+		return;
+	}
+	if (diagnosticsReferenceSet) {
+		diagnosticsStep++;
+		diagnosticsTime += delta;
+		if (diagnosticsStep % frameOptions.diagnosticsInterval != 0) return;
+	}
+
+	const Particle* particles = ParticlesContainer;
+	if (frameOptions.gpuSimulation) {
+		// Synchronous read back, acceptable every K steps in a diagnostics run
+		gpuReadback.resize(MaxParticles);
+		readGpuParticles(&gpuReadback[0], MaxParticles);
+		particles = &gpuReadback[0];
+	}
+	unsigned int markerIds[MaxGroups];
+	for (int g = 0; g < getGroupCount(); g++) markerIds[g] = getGroup(g).first + getGroup(g).count - 1;
+	PhysicsDiagnostics current = computeDiagnostics(particles, MaxParticles, markerIds, getGroupCount());
+
+	if (!diagnosticsReferenceSet) {
+		const char* forces = getNonGravityForces();
+		if (forces != NULL) printf("Diagnostics : the particles are not in free fall (%s), the invariants are not checked\n", forces);
+		diagnosticsReference = current;
+		diagnosticsReferenceSet = true;
+		diagnosticsStep = 0;
+		diagnosticsTime = 0.0;
+	}
+	checkDiagnostics(diagnosticsReference, current, diagnosticsTime, frameOptions.diagnosticsTolerance, getNonGravityForces() == NULL);
+}
+
+// One fixed substep of every particle
+static void stepSimulation(double delta) {
+	advanceScene((float)delta);
+	bool boomNow = !boomFlag && startFlag;
+	if (boomNow) {
+		if (!frameOptions.gpuSimulation && !isFluidEnabled()) boomParticles(); // The liquid has no boom, it is only spun
+		boomFlag = true;
+	}
+	if (frameOptions.gpuSimulation) {
+		// Single rotor in this mode
+		stepGpuSimulation((float)delta, getGroup(0).radius, getGroup(0).angle, startFlag, boomNow);
+	} else {
+		simulateScene(delta, startFlag);
+	}
+}
+
+// Move to the step closest to simulationStep + offset / substep, within the history
+static void scrubSimulation(double offset) {
+	if (!isHistoryEnabled()) return;
+	long long target = simulationStep + (long long)floor(offset / frameOptions.substep + 0.5);
+	target = std::max(getOldestHistoryStep(), std::min(target, historyHead));
+
+	HistoryState state;
+	long long keyframeStep = restoreKeyframe(target, state);
+	if (keyframeStep < 0) return;
+	startFlag = state.started;
+	boomFlag = state.boomed;
+	invalidateActiveSet(); // The asleep flags came back with the particles
+	// The inputs are constant between two keyframes, and the events come back at their steps :
+	// re-simulating gives back the same particles
+	getHistoryEvents(keyframeStep, target, scrubEvents);
+	size_t e = 0;
+	for (simulationStep = keyframeStep;; simulationStep++) {
+		for (; e < scrubEvents.size() && scrubEvents[e].step <= simulationStep; e++) {
+			const HistoryEvent& event = scrubEvents[e]; // shortcut
+			// Only the fluid depends on the order of the particles, the next frame sorts anyway
+			if (event.type == HistorySort && isFluidEnabled()) sortScene(event.cameraPosition);
+			else if (event.type == HistoryWake) wakeAllParticles();
+		}
+		if (simulationStep >= target) break;
+		stepSimulation(frameOptions.substep);
+	}
+	stepAccumulator = 0.0;
+	diagnosticsReferenceSet = false; // The invariants restart from the new present
+	resetTrails(); // The trails would jump across the scrub
+	printf("Scrubbed to t=%.3f s (%lld steps re-simulated)\n", target * frameOptions.substep, target - keyframeStep);
+}
+
+// Integrate the simulated time of this frame in fixed substeps, whatever the frame rate and the warp,
+// so that fast-forwarding does not degrade the integration. Returns the number of substeps.
+static int advanceSimulation(double realDelta) {
+	if (pauseFlag) {
+		stepAccumulator = 0.0;
+		return 0;
+	}
+	double step = frameOptions.substep;
+	double budgetEnd = getTimerSeconds() + frameOptions.stepBudget;
+	stepAccumulator += realDelta * timeWarp;
+	int substeps = 0;
+	// A replay integrates the substeps of the recorded frame, the ones the budget let through on the recording machine
+	while (replaySubsteps >= 0 ? substeps < replaySubsteps : stepAccumulator >= step) {
+		// At least one substep per frame, so that a tight budget slows the simulation down but never freezes it
+		// A recording without the substep counts integrates every substep, so that the workload does not depend on the machine
+		if (replaySubsteps < 0 && substeps > 0 && getTimerSeconds() > budgetEnd && !isInputReplaying()) break;
+		if (isHistoryEnabled()) {
+			// Resuming from the past : the recorded future is replaced by the new one, from a keyframe that holds
+			// the order and the wakes of the paused frames, which were not logged
+			bool resuming = simulationStep < historyHead;
+			if (resuming) truncateHistory(simulationStep);
+			HistoryState state = { startFlag, boomFlag };
+			recordHistory(simulationStep, state, resuming);
+		}
+		stepSimulation(step);
+		runDiagnostics((float)step);
+		simulationStep++;
+		historyHead = simulationStep;
+		stepAccumulator -= step;
+		substeps++;
+	}
+	if (replaySubsteps >= 0) stepAccumulator = 0.0;
+
+	// Behind real time : give up what could not be integrated rather than accumulating an ever growing debt
+	if (stepAccumulator >= step) {
+		double remainder = fmod(stepAccumulator, step);
+		droppedTime += stepAccumulator - remainder;
+		stepAccumulator = remainder;
+	}
+	return substeps;
+}
+
+static void reportLag(double time, RenderFrame& frame) {
+	frame.behind = droppedTime > 0.0;
+	if (time - lagReportTime < 1.0) return;
+	if (droppedTime > 0.0) {
+		double elapsed = time - lagReportTime;
+		double achieved = timeWarp - droppedTime / elapsed;
+		printf("Time warp %gx : simulation behind real time, %.3f s of simulated time dropped in %.1f s (%.3gx achieved, %d substeps last frame)\n",
+			timeWarp, droppedTime, elapsed, achieved, frame.substeps);
+	}
+	droppedTime = 0.0;
+	lagReportTime = time;
+}
+
+static void simulateFrame(double time, RenderFrame& frame) {
+
+	time = applyCommands(time);
+	if (isCameraPathEnabled()) {
+		// The path replaces the mouse
+		setRotateFlag(false);
+		setMoveFlag(false);
+		setCameraPose(sampleCameraPath(time - timeOrigin));
+	}
+
+	double realDelta = time - lastTime;
+	lastTime = time;
+
+	computeMatricesFromCursor(cursorX, cursorY);
+	frame.ViewMatrix = getViewMatrix();
+	frame.CameraPosition = getCameraPosition();
+	frame.split = splitFlag;
+	if (splitFlag) {
+		// Each view gets half of the window
+		glm::mat4 ProjectionMatrix = getProjectionMatrix(2.0f / 3.0f);
+		frame.ViewProjectionMatrix = ProjectionMatrix * frame.ViewMatrix;
+		frame.RotorViewMatrix = getRotorViewMatrix();
+		frame.RotorCameraPosition = getRotorCameraPosition();
+		frame.RotorViewProjectionMatrix = ProjectionMatrix * frame.RotorViewMatrix;
+	} else {
+		frame.ViewProjectionMatrix = getProjectionMatrix() * frame.ViewMatrix;
+	}
+
+	// Simulate all particles
+	frame.sortTime = 0.0;
+	frame.fillTime = 0.0;
+	double phaseStart = getTimerSeconds();
+	bool scrubbed = scrubOffset != 0.0;
+	if (scrubbed) {
+		scrubSimulation(scrubOffset);
+		scrubOffset = 0.0;
+	}
+	if (frameOptions.gpuSimulation) {
+		// Every particle stays in its slot, dead ones are collapsed by the shader.
+		// This mode is always serial, so the GPU query is issued from the GL thread.
+		beginGpuPhase(PhaseGpuSimulate);
+		frame.substeps = advanceSimulation(realDelta);
+		endGpuPhase();
+		recordInputFrame(time - timeOrigin, frame.substeps, frameCommands.data(), inputCommandCount);
+		reportLag(time, frame);
+		frame.simulateTime = getTimerSeconds() - phaseStart;
+		frame.count = MaxParticles;
+		frame.groups = 1;
+		frame.groupFirst[0] = 0;
+		frame.groupCount[0] = MaxParticles;
+		frame.culled = false;
+		frame.subsample = 1.0f;
+		frame.densityView = false;
+		return;
+	}
+
+	frame.substeps = advanceSimulation(realDelta);
+	recordInputFrame(time - timeOrigin, frame.substeps, frameCommands.data(), inputCommandCount);
+	reportLag(time, frame);
+
+	// Read once : the GL thread may change it while this frame is filled
+	RenderQuality quality = getRenderQuality();
+
+	// One trail sample per frame that moved, the GL thread uploads that slot only
+	frame.trailSlot = -1;
+	frame.trailSamples = 0;
+	if (isTrailsEnabled()) {
+		if (frame.substeps > 0) frame.trailSlot = recordTrails(ParticlesContainer, MaxParticles, simulationStep * frameOptions.substep, frame.trailSample);
+		frame.trailSamples = (int)(getTrailSamples() * quality.trailFraction); // The newest ones
+		frame.trailHead = getTrailHead();
+		getTrailAges(frame.trailAges);
+		frame.rotating = getNoninertialFlag();
+	}
+	// Every new state goes to the external readers, from this thread : the GL thread never waits for them
+	if (isStreamEnabled() && (frame.substeps > 0 || scrubbed)) {
+		publishStream(ParticlesContainer, MaxParticles, simulationStep, simulationStep * frameOptions.substep, getGroup(0).angle);
+	}
+	double sortStart = getTimerSeconds();
+	frame.simulateTime = sortStart - phaseStart;
+
+	frame.densityView = densityFlag && !splitFlag;
+	if (frame.densityView) {
+		// No billboard : nothing to sort, the grid replaces the instances
+		frame.densityMax = splatDensity(ParticlesContainer, MaxParticles, frame.ViewProjectionMatrix, frame.density);
+		frame.count = 0;
+		frame.groups = 0;
+		frame.culled = false;
+		frame.subsample = 1.0f;
+		frame.fillTime = getTimerSeconds() - sortStart;
+		return;
+	}
+	// Between two sorts the particles are drawn in the order of the last one. A recording or a replay sorts every
+	// frame : the order of the particles changes the sums of the fluid, so the replay would not match.
+	int sortInterval = isInputRecording() || isInputReplaying() ? 1 : quality.sortInterval;
+	if (++framesSinceSort >= sortInterval) {
+		sortScene(frame.CameraPosition);
+		if (simulationStep == historyHead) recordHistoryEvent(simulationStep, HistorySort, frame.CameraPosition);
+		framesSinceSort = 0;
+	}
+	double fillStart = getTimerSeconds();
+	frame.sortTime = fillStart - sortStart;
+
+	// Only what the camera can see is uploaded. The split view uploads everything, once for both cameras.
+	ViewCull cull = makeViewCull(frame.ViewProjectionMatrix, frame.CameraPosition, lodDistance, quality.subsample);
+	ViewCull subsampleCull = makeSubsampleCull(quality.subsample);
+	frame.culled = frameOptions.cull && !splitFlag;
+	const ViewCull* activeCull = frame.culled ? &cull : quality.subsample < 1.0f ? &subsampleCull : NULL;
+	frame.subsample = activeCull != NULL ? quality.subsample : 1.0f;
+	if (frameOptions.packed) {
+		// One origin/scale for all the groups, they are drawn together
+		computePackingBounds(ParticlesContainer, MaxParticles, activeCull, frame.packedOrigin, frame.packedScale);
+	}
+
+	// Each group gets a contiguous range of instances, in back to front order of the groups
+	int order[MaxGroups];
+	getGroupDrawOrder(frame.CameraPosition, order);
+	frame.groups = getGroupCount();
+	frame.count = 0;
+	for (int k = 0; k < frame.groups; k++) {
+		const CentrifugeGroup& group = getGroup(order[k]);
+		int instanceCount;
+		if (frameOptions.packed) {
+			instanceCount = quantizeParticles(ParticlesContainer + group.first, group.count, frame.packed + frame.count, frame.packedOrigin, frame.packedScale, activeCull);
+		} else {
+			// Colors and sizes are already on the GPU, they are fetched through the particle ID
+			instanceCount = fillInstances(ParticlesContainer + group.first, group.count, frame.instances + frame.count, activeCull);
+		}
+		frame.groupFirst[k] = frame.count;
+		frame.groupCount[k] = instanceCount;
+		frame.count += instanceCount;
+	}
+	if (splitFlag) {
+		// The instances are sorted for the lab camera, the rotor view only needs their order for its own
+		if (frameOptions.packed) sortPackedOrder(frame.packed, frame.count, frame.packedOrigin, frame.packedScale, frame.RotorCameraPosition, frame.rotorOrder);
+		else sortInstanceOrder(frame.instances, frame.count, frame.RotorCameraPosition, frame.rotorOrder);
+	}
+	frame.fillTime = getTimerSeconds() - fillStart;
+}
+
+const RenderFrame& simulateSerialFrame(double time) {
+	simulateFrame(time, frames[0]);
+	return frames[0];
+}
+
+// ********** Simulation thread **********
+static std::thread simulationThread;
+static std::mutex frameMutex;
+static std::condition_variable frameCondition;
+static bool frameRequested = false; // Set by the GL thread, cleared by the simulation thread
+static bool frameReady = false; // Set by the simulation thread, cleared by the GL thread
+static bool stopRequested = false;
+static double requestedTime;
+static int backFrame = 0; // Frame being simulated
+
+static void simulationLoop() {
+	for (;;) {
+		double time;
+		int target;
+		{
+			std::unique_lock<std::mutex> lock(frameMutex);
+			frameCondition.wait(lock, [] { return frameRequested || stopRequested; });
+			if (stopRequested) return;
+			frameRequested = false;
+			time = requestedTime;
+			target = backFrame;
+		}
+
+		simulateFrame(time, frames[target]);
+
+		{
+			std::lock_guard<std::mutex> lock(frameMutex);
+			frameReady = true;
+		}
+		frameCondition.notify_all();
+	}
+}
+
+void startSimulationThread(double time) {
+	stopRequested = false;
+	frameReady = false;
+	backFrame = 0;
+	simulationThread = std::thread(simulationLoop);
+	requestFrame(time);
+}
+
+const RenderFrame& waitForFrame() {
+	std::unique_lock<std::mutex> lock(frameMutex);
+	frameCondition.wait(lock, [] { return frameReady; });
+	frameReady = false;
+	return frames[backFrame];
+}
+
+void requestFrame(double time) {
+	{
+		std::lock_guard<std::mutex> lock(frameMutex);
+		backFrame = 1 - backFrame;
+		requestedTime = time;
+		frameRequested = true;
+	}
+	frameCondition.notify_all();
+}
+
+void stopSimulationThread() {
+	{
+		std::lock_guard<std::mutex> lock(frameMutex);
+		stopRequested = true;
+	}
+	frameCondition.notify_all();
+	simulationThread.join();
+}
+// ********** Simulation thread **********
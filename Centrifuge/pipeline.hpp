@@ -0,0 +1,91 @@
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+// Input commands, produced by the GLFW callbacks and consumed by whoever runs simulateFrame()
+enum CommandType {
+	CommandToggleStart,       // Space : start/stop the simulation
+	CommandToggleNoninertial, // Enter : switch between the lab and the rotor view
+	CommandRotate,            // Left button : x != 0 while pressed
+	CommandMove,              // Right button : x != 0 while pressed
+	CommandScroll,            // Wheel : y offset
+	CommandCursor,            // Cursor position (x, y), pushed once per frame
+	CommandTimeWarp,          // +/- : multiply the time warp by x
+	CommandTogglePause,       // P : stop/resume the time, the camera still moves
+	CommandScrub,             // Left/right arrows : move x simulated seconds in the history
+	CommandToggleDensity,     // D : switch between the billboards and the density view
+	CommandWakeParticles,     // W : wake every sleeping particle, see sleep.hpp
+	CommandToggleSplitView    // V : show the lab and the rotor views side by side
+};
+
+struct Command {
+	CommandType type;
+	double x, y;
+};
+
+// Lock-free single producer / single consumer queue. Returns false (and drops the command) if full.
+bool pushCommand(CommandType type, double x = 0.0, double y = 0.0);
+
+// Everything the GL thread needs to draw one frame
+struct RenderFrame {
+	ParticleInstance* instances;
+	PackedInstance* packed;
+	int count; // Number of instances to draw
+	int groups; // One draw command per centrifuge group, see scene.hpp
+	int groupFirst[MaxGroups], groupCount[MaxGroups]; // Instance range of each command, contiguous and in draw order
+	glm::vec3 packedOrigin, packedScale;
+	glm::mat4 ViewMatrix;
+	glm::mat4 ViewProjectionMatrix;
+	glm::vec3 CameraPosition;
+	// Split view : the lab view above on the left half of the window, the rotor view on the right half.
+	// Both draw the same instances, the rotor view in the order of rotorOrder.
+	bool split;
+	glm::mat4 RotorViewMatrix;
+	glm::mat4 RotorViewProjectionMatrix;
+	glm::vec3 RotorCameraPosition;
+	unsigned int* rotorOrder; // count instance indices, back to front from the rotor camera
+	bool culled; // TRUE if the distance based thinning was applied
+	float subsample; // Fraction of the particles kept by the governor, see governor.hpp. 1 : all of them
+	bool densityView; // TRUE if the frame is the density grid instead of instances
+	float* density; // DensityWidth * DensityHeight particle counts, see density.hpp
+	float densityMax;
+	int trailSlot; // Trail slot sampled for this frame, -1 if none (paused), see trails.hpp
+	float* trailSample; // Its x, y and z planes, MaxParticles floats each. NULL without trails.
+	int trailHead, trailSamples; // Newest slot and number of samples of the trail ring
+	float trailAges[MaxTrailLength]; // Simulated seconds from each slot to the newest one
+	bool rotating; // Noninertial view when the frame was simulated
+	double simulateTime, sortTime, fillTime; // CPU time of each phase, in seconds, see timing.hpp
+	int substeps; // Fixed substeps integrated for this frame
+	bool behind; // TRUE if simulated time was dropped to stay within the step budget since the last lag report
+};
+
+struct FrameOptions {
+	bool gpuSimulation; // Step on the GPU, the frame must be simulated on the GL thread
+	bool packed; // Fill the packed instances instead of the float ones
+	bool cull; // Frustum culling and distance based thinning
+	bool density; // Start in the density view
+	bool split; // Start in the split view, the culling and the density view are off while it is shown
+	int diagnosticsInterval; // Check the conservation invariants every this many steps, 0 : never
+	double diagnosticsTolerance; // Relative drift beyond which an invariant is flagged
+	double timeWarp; // Initial simulated seconds per real second, changed at runtime by CommandTimeWarp
+	double substep; // Fixed integration step, in simulated seconds
+	double stepBudget; // CPU time allowed for the substeps of one frame, in seconds. Beyond, simulated time is dropped.
+};
+
+void initFrames(const FrameOptions& options, double time);
+void cleanupFrames();
+// TRUE once the input replay or the camera path is over, the run should end (see replay.hpp)
+bool isScriptFinished();
+
+// Serial mode : apply the pending commands, move the camera, step the particles and fill the instances,
+// all on the calling thread. Required with the GPU simulation.
+const RenderFrame& simulateSerialFrame(double time);
+
+// Pipelined mode : a simulation thread produces frame N+1 while the GL thread draws frame N
+void startSimulationThread(double time);
+// Wait for the frame in flight. It is not touched by the simulation until the next waitForFrame().
+const RenderFrame& waitForFrame();
+// Start simulating the next frame into the other buffer
+void requestFrame(double time);
+void stopSimulationThread();
+
+#endif
@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "controls.hpp"
+#include "simulation.hpp"
+#include "culling.hpp"
+#include "packing.hpp"
+#include "scene.hpp"
+#include "trails.hpp"
+#include "pipeline.hpp"
+#include "replay.hpp"
+
+// Same order as CommandType
+static const char* const commandNames[] = {
+	"start", "noninertial", "rotate", "move", "scroll", "cursor", "warp", "pause", "scrub", "density", "wake", "split"
+};
+
+const char* getCommandName(CommandType type) {
+	if (type < 0 || type >= (int)(sizeof(commandNames) / sizeof(commandNames[0]))) return NULL;
+	return commandNames[type];
+}
+
+bool findCommand(const char* name, CommandType& type) {
+	for (int i = 0; i < (int)(sizeof(commandNames) / sizeof(commandNames[0])); i++) {
+		if (strcmp(name, commandNames[i]) == 0) {
+			type = (CommandType)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// ********** Input recording **********
+static FILE* recordFile = NULL;
+
+// Replay : the whole recording is loaded up front, the frames are read from memory
+struct ReplayFrame {
+	double time;
+	int substeps; // -1 in the recordings made before the counts were written
+	int first, count; // Range in replayCommands
+};
+static std::vector<ReplayFrame> replayFrames;
+static std::vector<Command> replayCommands;
+static size_t replayNext = 0;
+static bool replayFlag = false;
+
+bool initInputRecording(const char* path, const char* comment) {
+	recordFile = fopen(path, "w");
+	if (recordFile == NULL) {
+		fprintf(stderr, "Cannot write the input recording %s\n", path);
+		return false;
+	}
+	fprintf(recordFile, "# Centrifuge input recording\n# %s\n", comment);
+	printf("Recording the input to %s\n", path);
+	return true;
+}
+
+bool isInputRecording() {
+	return recordFile != NULL;
+}
+
+void recordInputFrame(double time, int substeps, const Command* commands, int count) {
+	if (recordFile == NULL) return;
+	// Round trip exact : the replay must integrate the same substeps
+	fprintf(recordFile, "f %.17g %d\n", time, substeps);
+	for (int i = 0; i < count; i++) {
+		fprintf(recordFile, "c %s %.17g %.17g\n", getCommandName(commands[i].type), commands[i].x, commands[i].y);
+	}
+}
+
+bool initInputReplay(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot read the input recording %s\n", path);
+		return false;
+	}
+	replayFrames.clear();
+	replayCommands.clear();
+	char line[256], name[64];
+	int lineNumber = 0;
+	bool valid = true;
+	while (valid && fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		ReplayFrame frame;
+		Command command;
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+		int fields = sscanf(line, "f %lf %d", &frame.time, &frame.substeps);
+		if (fields >= 1) {
+			if (fields == 1) frame.substeps = -1;
+			frame.first = (int)replayCommands.size();
+			frame.count = 0;
+			replayFrames.push_back(frame);
+		}
+		else if (sscanf(line, "c %63s %lf %lf", name, &command.x, &command.y) == 3 && findCommand(name, command.type) && !replayFrames.empty()) {
+			replayCommands.push_back(command);
+			replayFrames.back().count++;
+		}
+		else valid = false;
+	}
+	fclose(file);
+	if (!valid) {
+		fprintf(stderr, "%s:%d : invalid input recording line\n", path, lineNumber);
+		return false;
+	}
+	replayNext = 0;
+	replayFlag = true;
+	printf("Replaying %d frames of input from %s\n", (int)replayFrames.size(), path);
+	return true;
+}
+
+bool isInputReplaying() {
+	return replayFlag;
+}
+
+bool replayInputFrame(double& time, int& substeps, std::vector<Command>& commands) {
+	commands.clear();
+	substeps = -1;
+	if (replayNext >= replayFrames.size()) return false;
+	const ReplayFrame& frame = replayFrames[replayNext++]; // shortcut
+	time = frame.time;
+	substeps = frame.substeps;
+	commands.insert(commands.end(), replayCommands.begin() + frame.first, replayCommands.begin() + frame.first + frame.count);
+	return true;
+}
+// ********** Input recording **********
+
+// ********** Camera path **********
+struct CameraKeyframe {
+	double time;
+	CameraPose pose;
+};
+struct TimedCommand {
+	double time;
+	Command command;
+};
+static std::vector<CameraKeyframe> cameraKeyframes;
+static std::vector<TimedCommand> cameraCommands;
+
+bool loadCameraPath(const char* path) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		fprintf(stderr, "Cannot read the camera path %s\n", path);
+		return false;
+	}
+	cameraKeyframes.clear();
+	cameraCommands.clear();
+	char line[256], name[64];
+	int lineNumber = 0;
+	bool valid = true;
+	while (valid && fgets(line, sizeof(line), file) != NULL) {
+		lineNumber++;
+		CameraKeyframe keyframe;
+		CameraPose& pose = keyframe.pose; // shortcut
+		TimedCommand timed;
+		timed.command.x = timed.command.y = 0.0;
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+		if (sscanf(line, "at %lf %63s %lf %lf", &timed.time, name, &timed.command.x, &timed.command.y) >= 2) {
+			valid = findCommand(name, timed.command.type);
+			cameraCommands.push_back(timed);
+		}
+		else if (sscanf(line, "%lf %f %f %f %f %f %f", &keyframe.time, &pose.horizontalAngle, &pose.verticalAngle, &pose.viewDistance,
+			&pose.centerPoint.x, &pose.centerPoint.y, &pose.centerPoint.z) == 7) {
+			valid = cameraKeyframes.empty() || keyframe.time > cameraKeyframes.back().time;
+			cameraKeyframes.push_back(keyframe);
+		}
+		else valid = false;
+	}
+	fclose(file);
+	if (!valid || cameraKeyframes.empty()) {
+		fprintf(stderr, "%s:%d : invalid camera path line, or no keyframe (times must increase)\n", path, lineNumber);
+		cameraKeyframes.clear();
+		cameraCommands.clear();
+		return false;
+	}
+	std::stable_sort(cameraCommands.begin(), cameraCommands.end(), [](const TimedCommand& a, const TimedCommand& b) { return a.time < b.time; });
+	printf("Camera path : %d keyframes over %.1f s, %d commands\n", (int)cameraKeyframes.size(), cameraKeyframes.back().time, (int)cameraCommands.size());
+	return true;
+}
+
+bool isCameraPathEnabled() {
+	return !cameraKeyframes.empty();
+}
+
+CameraPose sampleCameraPath(double time) {
+	// Held before the first keyframe and after the last one
+	if (time <= cameraKeyframes.front().time) return cameraKeyframes.front().pose;
+	if (time >= cameraKeyframes.back().time) return cameraKeyframes.back().pose;
+	size_t k = 1;
+	while (cameraKeyframes[k].time < time) k++;
+	const CameraKeyframe& a = cameraKeyframes[k - 1]; // shortcut
+	const CameraKeyframe& b = cameraKeyframes[k]; // shortcut
+	float t = (float)((time - a.time) / (b.time - a.time));
+	CameraPose pose;
+	pose.horizontalAngle = mix(a.pose.horizontalAngle, b.pose.horizontalAngle, t);
+	pose.verticalAngle = mix(a.pose.verticalAngle, b.pose.verticalAngle, t);
+	pose.viewDistance = mix(a.pose.viewDistance, b.pose.viewDistance, t);
+	pose.centerPoint = mix(a.pose.centerPoint, b.pose.centerPoint, t);
+	return pose;
+}
+
+void getCameraPathCommands(double from, double to, std::vector<Command>& commands) {
+	for (size_t i = 0; i < cameraCommands.size(); i++) {
+		if (cameraCommands[i].time > from && cameraCommands[i].time <= to) commands.push_back(cameraCommands[i].command);
+	}
+}
+
+bool isCameraPathFinished(double time) {
+	return !cameraKeyframes.empty() && time > cameraKeyframes.back().time;
+}
+// ********** Camera path **********
+
+void cleanupReplay() {
+	if (recordFile != NULL) fclose(recordFile);
+	recordFile = NULL;
+	replayFlag = false;
+	std::vector<ReplayFrame>().swap(replayFrames);
+	std::vector<Command>().swap(replayCommands);
+	cameraKeyframes.clear();
+	cameraCommands.clear();
+}
@@ -0,0 +1,52 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+// Reproducible runs, so that two builds or two machines render the same workload.
+//
+// Input recording : every input reaches the simulation through the command queue of pipeline.hpp, the cursor
+// included. The recording is the list of the frames, each with its time, its substeps and the commands applied in it :
+//   # any comment, e.g. the command line of the recorded run
+//   f <time> <substeps>       a frame simulated at time seconds after the first one, in substeps fixed steps
+//   c <command> <x> <y>       a command applied in that frame, by name : start, cursor, scroll...
+// A replay feeds the recorded times and commands to the same frames and ignores the live input. It is only
+// deterministic with the same options (rotors, warp, substep...) : each frame integrates the recorded substeps,
+// whatever the speed of the machine and the step budget, so it matches the recorded run even where that one
+// fell behind real time. A frame line without substeps integrates every substep of its time.
+// The run stops at the end of the recording.
+//
+// Camera path : keyframes of the camera, one per line, interpolated linearly between them :
+//   <time> <horizontalAngle> <verticalAngle> <viewDistance> <centerX> <centerY> <centerZ>
+// and commands at a given time, e.g. the boom after one second :
+//   at 1.0 start
+// The path replaces the mouse. The run stops after the last keyframe.
+
+// Command names of both formats, NULL if unknown
+const char* getCommandName(CommandType type);
+bool findCommand(const char* name, CommandType& type);
+
+// ********** Input recording **********
+// comment : written at the top of the file, e.g. the command line
+bool initInputRecording(const char* path, const char* comment);
+bool isInputRecording();
+// Once the frame is simulated : its substeps and the commands applied before them
+void recordInputFrame(double time, int substeps, const Command* commands, int count);
+
+bool initInputReplay(const char* path);
+bool isInputReplaying();
+// Next recorded frame : its time, its substeps (-1 if not recorded) and its commands. FALSE once the recording is over.
+bool replayInputFrame(double& time, int& substeps, std::vector<Command>& commands);
+// ********** Input recording **********
+
+// ********** Camera path **********
+bool loadCameraPath(const char* path);
+bool isCameraPathEnabled();
+CameraPose sampleCameraPath(double time);
+// Commands of the path in (from, to]
+void getCameraPathCommands(double from, double to, std::vector<Command>& commands);
+bool isCameraPathFinished(double time);
+// ********** Camera path **********
+
+// Close the recording
+void cleanupReplay();
+
+#endif
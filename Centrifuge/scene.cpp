@@ -0,0 +1,224 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+using namespace glm;
+
+#include "controls.hpp"
+#include "simulation.hpp"
+#include "forces.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "sleep.hpp"
+#include "fluid.hpp"
+
+static CentrifugeGroup groups[MaxGroups];
+static int groupCount = 0;
+
+static std::vector<int> activeSlots;
+static bool activeSetStale = true;
+static int sleepingCount = 0;
+static std::vector<char> chunkChanged; // A particle of the chunk died or fell asleep during the step
+
+// Sort : the keys are sorted, then the particles are gathered in their order, which also tells where each slot went
+struct SortKey {
+	unsigned long long key; // Distance from the far end, then particle ID
+	int slot;
+	bool operator<(const SortKey& that) const {
+		return key < that.key;
+	}
+};
+static std::vector<SortKey> sortKeys;
+static std::vector<Particle> sortedParticles;
+static std::vector<int> slotRemap; // New slot of each slot
+
+void initScene(int count) {
+	groupCount = std::max(1, std::min(count, MaxGroups));
+	int columns = (int)ceil(sqrt((float)groupCount));
+	float spacing = 4.0f * getCentrifugeRadius();
+
+	for (int g = 0; g < groupCount; g++) {
+		CentrifugeGroup& group = groups[g]; // shortcut
+		group.first = (int)((long long)MaxParticles * g / groupCount);
+		group.count = (int)((long long)MaxParticles * (g + 1) / groupCount) - group.first;
+
+		// Group 0 is the original rotor, the others vary around it so that they can be compared side by side
+		group.center = glm::vec3((g % columns) * spacing, (g / columns) * spacing, 0.0f);
+		group.radius = getCentrifugeRadius() * (1.0f + 0.4f * sin(1.7f * g));
+		group.speed = centrifugeSpeed * (1.0f + 0.5f * sin(2.3f * g));
+		group.angle = g == 0 ? getCentrifugeAngle() : 0.0f;
+
+		initParticles(ParticlesContainer + group.first, BoomKicks + group.first, group.count, group.radius, group.angle);
+		for (int i = group.first; i < group.first + group.count; i++) {
+			ParticlesContainer[i].pos += group.center;
+			ParticlesContainer[i].id += group.first; // IDs index the attribute table of the whole container
+		}
+	}
+	activeSetStale = true;
+}
+
+int getGroupCount() {
+	return groupCount;
+}
+
+const CentrifugeGroup& getGroup(int group) {
+	return groups[group];
+}
+
+void advanceScene(float delta) {
+	for (int g = 0; g < groupCount; g++) {
+		groups[g].angle += groups[g].speed * delta;
+	}
+	setCentrifugeAngle(groups[0].angle);
+}
+
+void getSceneAngles(float* angles) {
+	for (int g = 0; g < groupCount; g++) angles[g] = groups[g].angle;
+}
+
+void setSceneAngles(const float* angles) {
+	for (int g = 0; g < groupCount; g++) groups[g].angle = angles[g];
+	setCentrifugeAngle(groups[0].angle);
+}
+
+void invalidateActiveSet() {
+	activeSetStale = true;
+}
+
+int getActiveCount() {
+	return (int)activeSlots.size();
+}
+
+int getSleepingCount() {
+	return sleepingCount;
+}
+
+static void buildActiveSet() {
+	activeSlots.clear();
+	sleepingCount = 0;
+	for (int i = 0; i < MaxParticles; i++) {
+		const Particle& p = ParticlesContainer[i]; // shortcut
+		if (p.life <= 0.0f) continue;
+		if (p.asleep) sleepingCount++;
+		else activeSlots.push_back(i);
+	}
+	activeSetStale = false;
+}
+
+void simulateScene(double delta, bool started) {
+	if (isFluidEnabled()) {
+		// The liquid is the particles of group 0 but its marker, see fluid.hpp
+		const CentrifugeGroup& group = groups[0]; // shortcut
+		stepFluid(ParticlesContainer + group.first, group.count - 1, delta, group.center, group.speed, group.angle, started);
+		return;
+	}
+	if (activeSetStale) buildActiveSet();
+	// Stopped : the particles go back on their rotors, the sleeping ones as well
+	if (!started && sleepingCount > 0) {
+		wakeAllParticles();
+		buildActiveSet();
+	}
+	int activeCount = (int)activeSlots.size();
+	if (activeCount == 0) return;
+
+	// The rotor terms only change from step to step, not from particle to particle
+	RotorStep rotors[MaxGroups];
+	for (int g = 0; g < groupCount; g++) {
+		rotors[g] = makeRotorStep(groups[g].center, groups[g].radius, groups[g].speed, groups[g].angle);
+	}
+	bool sleepFlag = started && isSleepEnabled();
+	const SleepRegion& region = getSleepRegion(); // shortcut
+
+	chunkChanged.assign(getChunkCount(activeCount), 0);
+	parallelFor(activeCount, [&](int begin, int end, int chunk) {
+		// Slots are in container order and groups are contiguous : find the one holding the first slot, then walk forward
+		int g = 0;
+		while (groups[g].first + groups[g].count <= activeSlots[begin]) g++;
+		bool changed = false;
+		for (int k = begin; k < end; k++) {
+			int i = activeSlots[k];
+			while (i >= groups[g].first + groups[g].count) g++;
+			const CentrifugeGroup& group = groups[g]; // shortcut
+			Particle& p = ParticlesContainer[i]; // shortcut
+			p.life -= (float)delta;
+			if (p.life > 0.0f) {
+
+				if (i != group.first + group.count - 1) {
+					integrateParticle<ActiveForces>(p, (SimulationPrecision::Time)delta, rotors[g], started);
+					if (sleepFlag && settleParticle(p, region)) {
+						p.asleep = true;
+						changed = true;
+					}
+				}
+
+			}
+			else {
+				// Particles that just died will be put at the end of their group in sortScene()
+				changed = true;
+			}
+		}
+		chunkChanged[chunk] = changed;
+	});
+
+	// Keep the set compact : the particles that died or fell asleep cost nothing from the next step on
+	if (std::find(chunkChanged.begin(), chunkChanged.end(), 1) == chunkChanged.end()) return;
+	std::vector<int>::iterator kept = std::remove_if(activeSlots.begin(), activeSlots.end(), [](int i) {
+		return ParticlesContainer[i].life <= 0.0f || ParticlesContainer[i].asleep;
+	});
+	for (std::vector<int>::iterator k = kept; k != activeSlots.end(); k++) {
+		if (ParticlesContainer[*k].life > 0.0f) sleepingCount++;
+	}
+	activeSlots.erase(kept, activeSlots.end());
+}
+
+void sortScene(const glm::vec3& CameraPosition) {
+	sortKeys.resize(MaxParticles);
+	sortedParticles.resize(MaxParticles);
+	slotRemap.resize(MaxParticles);
+
+	// Every distance is taken here, from this camera : the sleeping particles have not moved, but the camera has.
+	// Ties are broken by ID, so the order only depends on the particles and the camera, not on the previous order.
+	parallelFor(MaxParticles, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			Particle& p = ParticlesContainer[i]; // shortcut
+			unsigned int far = 0xFFFFFFFFu; // Dead : after every live particle
+			if (p.life > 0.0f) {
+				p.cameradistance = glm::length2(glm::vec3(p.pos) - CameraPosition);
+				unsigned int bits;
+				memcpy(&bits, &p.cameradistance, sizeof(bits));
+				far = 0x7FFFFFFFu - bits; // Positive floats order like their bits
+			}
+			else p.cameradistance = -1.0f;
+			sortKeys[i].key = ((unsigned long long)far << 32) | p.id;
+			sortKeys[i].slot = i;
+		}
+	});
+	// Within each group, back to front. The marker keeps the last slot of its group, the step finds it there.
+	for (int g = 0; g < groupCount; g++) {
+		std::sort(sortKeys.begin() + groups[g].first, sortKeys.begin() + groups[g].first + groups[g].count - 1);
+	}
+	parallelFor(MaxParticles, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			sortedParticles[i] = ParticlesContainer[sortKeys[i].slot];
+			slotRemap[sortKeys[i].slot] = i;
+		}
+	});
+	memcpy(ParticlesContainer, &sortedParticles[0], MaxParticles * sizeof(Particle));
+
+	// The active set follows its particles, back in container order : no scan of the sleeping ones
+	if (!activeSetStale) {
+		for (size_t k = 0; k < activeSlots.size(); k++) activeSlots[k] = slotRemap[activeSlots[k]];
+		std::sort(activeSlots.begin(), activeSlots.end());
+	}
+}
+
+void getGroupDrawOrder(const glm::vec3& CameraPosition, int* order) {
+	for (int g = 0; g < groupCount; g++) order[g] = g;
+	std::sort(order, order + groupCount, [&](int a, int b) {
+		return glm::length2(groups[a].center - CameraPosition) > glm::length2(groups[b].center - CameraPosition);
+	});
+}
@@ -0,0 +1,43 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+// An independent centrifuge and the particles it carries
+struct CentrifugeGroup {
+	glm::vec3 center;
+	float radius;
+	float speed; // Angular speed of the rotor (rad/s)
+	float angle;
+	int first, count; // Range in ParticlesContainer. The last particle of the range is the marker of the rotor.
+};
+
+const int MaxGroups = 64;
+
+// Split ParticlesContainer between groupCount rotors. Group 0 is the rotor of controls.cpp,
+// the others are laid out on a grid around it, each with its own radius and speed.
+void initScene(int groupCount);
+int getGroupCount();
+const CentrifugeGroup& getGroup(int group);
+
+// Turn every rotor by its own speed. controls.cpp follows group 0 for the rotating view.
+void advanceScene(float delta);
+// Angle of every group, to save and restore the rotors with the particles (history.hpp)
+void getSceneAngles(float* angles);
+void setSceneAngles(const float* angles);
+// Step the particles of every group in one parallel pass over the active set
+void simulateScene(double delta, bool started);
+// Back to front from CameraPosition within each group : the groups keep their ranges, and their markers their slots.
+// The distances of every live particle are refreshed, the order only depends on them and on the particle IDs.
+void sortScene(const glm::vec3& CameraPosition);
+
+// The active set : slots of the live, awake particles, in container order, the only ones simulateScene() steps.
+// The particles that die or fall asleep during a step are dropped from it at the end of the step.
+// sortScene() moves it with its particles. It is rebuilt on the next step after invalidateActiveSet(),
+// when the container was restored or woken up by someone else.
+void invalidateActiveSet();
+int getActiveCount();
+// Live particles asleep at the last step, see sleep.hpp
+int getSleepingCount();
+// Group indices from the farthest to the nearest rotor, so that the groups blend in the right order
+void getGroupDrawOrder(const glm::vec3& CameraPosition, int* order);
+
+#endif
@@ -1,102 +1,225 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <iostream>
-#include <fstream>
 #include <algorithm>
 using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
 #include <GL/glew.h>
 
 #include "shader.hpp"
 
-GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path) {
+static bool shaderCacheEnabled = true;
 
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+void setShaderCacheEnabled(bool enabled) {
+	shaderCacheEnabled = enabled;
+}
 
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if (VertexShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
+// Read a whole file in a single read
+static bool readShaderFile(const char * file_path, std::string& code) {
+	FILE * file = fopen(file_path, "rb");
+	if (file == NULL) {
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", file_path);
+		return false;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	code.resize(size > 0 ? size : 0);
+	size_t read = size > 0 ? fread(&code[0], 1, size, file) : 0;
+	fclose(file);
+	code.resize(read);
+	return true;
+}
+
+// ********** Program binary cache **********
+// <vertex shader>.cache holds the binary of the last program linked from that vertex shader.
+// It is only reused if the key (hash of the sources, the varyings and the driver) matches.
+const unsigned int ShaderCacheMagic = 0x42505343; // "CSPB"
+
+struct ShaderCacheHeader {
+	unsigned int magic;
+	unsigned int format; // Binary format returned by glGetProgramBinary
+	unsigned long long key;
+	unsigned int length;
+};
+
+// FNV-1a
+static unsigned long long hashString(unsigned long long hash, const char * text) {
+	for (const unsigned char * c = (const unsigned char *)text; *c; c++) {
+		hash ^= *c;
+		hash *= 1099511628211ull;
+	}
+	return hash ^ 0xFF; // Separator, so that ("ab", "c") and ("a", "bc") differ
+}
+
+static unsigned long long programKey(const std::string * sources, int sourceCount, const char * const * varyings, int varyingCount) {
+	unsigned long long key = 14695981039346656037ull;
+	for (int i = 0; i < sourceCount; i++) key = hashString(key, sources[i].c_str());
+	for (int i = 0; i < varyingCount; i++) key = hashString(key, varyings[i]);
+	key = hashString(key, (const char *)glGetString(GL_VENDOR));
+	key = hashString(key, (const char *)glGetString(GL_RENDERER));
+	key = hashString(key, (const char *)glGetString(GL_VERSION));
+	return key;
+}
+
+static bool isShaderCacheUsable() {
+	if (!shaderCacheEnabled || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) return false;
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+// Returns 0 if there is no usable binary for this key
+static GLuint loadCachedProgram(const std::string& cache_path, unsigned long long key) {
+	FILE * file = fopen(cache_path.c_str(), "rb");
+	if (file == NULL) return 0;
+
+	ShaderCacheHeader header;
+	std::vector<char> binary;
+	bool valid = fread(&header, sizeof(header), 1, file) == 1
+		&& header.magic == ShaderCacheMagic && header.key == key && header.length > 0;
+	if (valid) {
+		binary.resize(header.length);
+		valid = fread(&binary[0], 1, header.length, file) == header.length;
 	}
-	else {
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
+	fclose(file);
+	if (!valid) return 0;
+
+	GLuint ProgramID = glCreateProgram();
+	glProgramBinary(ProgramID, header.format, &binary[0], header.length);
+	GLint Result = GL_FALSE;
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	if (Result != GL_TRUE) {
+		// The driver refused it (e.g. updated without changing its version string)
+		glDeleteProgram(ProgramID);
 		return 0;
 	}
+	printf("Loaded cached program %s\n", cache_path.c_str());
+	return ProgramID;
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if (FragmentShaderStream.is_open()) {
-		std::string Line = "";
-		while (getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+static void saveCachedProgram(const std::string& cache_path, unsigned long long key, GLuint ProgramID) {
+	GLint length = 0;
+	glGetProgramiv(ProgramID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return;
+
+	ShaderCacheHeader header;
+	std::vector<char> binary(length);
+	glGetProgramBinary(ProgramID, length, NULL, &header.format, &binary[0]);
+	header.magic = ShaderCacheMagic;
+	header.key = key;
+	header.length = length;
+
+	// Written aside then renamed over the cache : another process loading it never sees a partial file,
+	// and a failed write (disk full) leaves the previous cache in place
+	static int saveCount = 0;
+	char suffix[64];
+#ifdef _WIN32
+	sprintf(suffix, ".%lu.%d.tmp", (unsigned long)GetCurrentProcessId(), saveCount++);
+#else
+	sprintf(suffix, ".%ld.%d.tmp", (long)getpid(), saveCount++);
+#endif
+	std::string temp_path = cache_path + suffix;
+
+	FILE * file = fopen(temp_path.c_str(), "wb");
+	if (file == NULL) return; // Read-only directory : no cache, not an error
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&binary[0], 1, length, file) == (size_t)length;
+	written = fclose(file) == 0 && written;
+	if (written) {
+#ifdef _WIN32
+		written = MoveFileExA(temp_path.c_str(), cache_path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+		written = rename(temp_path.c_str(), cache_path.c_str()) == 0;
+#endif
 	}
+	if (!written) {
+		printf("Could not write the program cache %s\n", cache_path.c_str());
+		remove(temp_path.c_str());
+	}
+}
+// ********** Program binary cache **********
 
+static void compileShader(GLuint ShaderID, const char * file_path, const std::string& code) {
 	GLint Result = GL_FALSE;
 	int InfoLogLength;
 
+	// Compile Shader
+	printf("Compiling shader : %s\n", file_path);
+	char const * SourcePointer = code.c_str();
+	glShaderSource(ShaderID, 1, &SourcePointer, NULL);
+	glCompileShader(ShaderID);
 
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	// Check Shader
+	glGetShaderiv(ShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if (InfoLogLength > 0) {
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+		std::vector<char> ShaderErrorMessage(InfoLogLength + 1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
 	}
+}
+
+// Returns the link status
+static bool checkProgram(GLuint ProgramID) {
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
 
+	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (InfoLogLength > 0) {
+		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
+	}
+	return Result == GL_TRUE;
+}
 
+GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path) {
 
-	// Compile Fragment Shader
-	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-	glCompileShader(FragmentShaderID);
+	// Read the Vertex Shader and the Fragment Shader code from the files
+	std::string ShaderCode[2];
+	if (!readShaderFile(vertex_file_path, ShaderCode[0])) {
+		return 0;
+	}
+	readShaderFile(fragment_file_path, ShaderCode[1]);
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+	bool useCache = isShaderCacheUsable();
+	std::string cache_path = std::string(vertex_file_path) + ".cache";
+	unsigned long long key = 0;
+	if (useCache) {
+		key = programKey(ShaderCode, 2, NULL, 0);
+		GLuint ProgramID = loadCachedProgram(cache_path, key);
+		if (ProgramID != 0) return ProgramID;
 	}
 
+	// Create the shaders
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
 
+	compileShader(VertexShaderID, vertex_file_path, ShaderCode[0]);
+	compileShader(FragmentShaderID, fragment_file_path, ShaderCode[1]);
 
 	// Link the program
 	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (useCache) glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(ProgramID);
 
 	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if (InfoLogLength > 0) {
-		std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
-	}
+	bool linked = checkProgram(ProgramID);
+	if (linked && useCache) saveCachedProgram(cache_path, key, ProgramID);
 
 
 	glDetachShader(ProgramID, VertexShaderID);
@@ -109,3 +232,47 @@ GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_pat
 }
 
 
+GLuint LoadTransformFeedbackShader(const char * vertex_file_path, const char * const * varyings, int varyingCount) {
+
+	// Read the Vertex Shader code from the file
+	std::string VertexShaderCode;
+	if (!readShaderFile(vertex_file_path, VertexShaderCode)) {
+		return 0;
+	}
+
+	// The varyings are part of the key, the binary holds the transform feedback layout
+	bool useCache = isShaderCacheUsable();
+	std::string cache_path = std::string(vertex_file_path) + ".cache";
+	unsigned long long key = 0;
+	if (useCache) {
+		key = programKey(&VertexShaderCode, 1, varyings, varyingCount);
+		GLuint ProgramID = loadCachedProgram(cache_path, key);
+		if (ProgramID != 0) return ProgramID;
+	}
+
+	// Create the shader
+	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
+	compileShader(VertexShaderID, vertex_file_path, VertexShaderCode);
+
+	// Link the program, the varyings must be declared before linking
+	printf("Linking program\n");
+	GLuint ProgramID = glCreateProgram();
+	glAttachShader(ProgramID, VertexShaderID);
+	glTransformFeedbackVaryings(ProgramID, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+	if (useCache) glProgramParameteri(ProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(ProgramID);
+
+	// Check the program
+	bool linked = checkProgram(ProgramID);
+
+	glDetachShader(ProgramID, VertexShaderID);
+	glDeleteShader(VertexShaderID);
+
+	if (!linked) {
+		glDeleteProgram(ProgramID);
+		return 0;
+	}
+	if (useCache) saveCachedProgram(cache_path, key, ProgramID);
+
+	return ProgramID;
+}
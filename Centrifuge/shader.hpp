@@ -1,6 +1,14 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+// Both loaders keep the linked program binary in <vertex_file_path>.cache and reload it on the next launch
+// if the sources and the driver are the same, compiling only when it is missing or stale.
 GLuint LoadShaders(const char * vertex_file_path, const char * fragment_file_path);
 
+// Load a vertex-only program whose outputs are captured by transform feedback (interleaved)
+GLuint LoadTransformFeedbackShader(const char * vertex_file_path, const char * const * varyings, int varyingCount);
+
+// Compile every program from source, without reading or writing the cache
+void setShaderCacheEnabled(bool enabled);
+
 #endif
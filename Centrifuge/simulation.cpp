@@ -0,0 +1,132 @@
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtx/norm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "forces.hpp"
+
+Particle ParticlesContainer[MaxParticles];
+glm::vec3 BoomKicks[MaxParticles]; // Velocity added to each particle when the boom happens
+
+void initParticles(Particle* particles, glm::vec3* kicks, int count, float radius, float angle) {
+	for (int i = 0; i < count - 1; i++) {
+		int particleIndex = i;
+		particles[particleIndex].id = i;
+
+		particles[particleIndex].pos = glm::vec3(radius*sin(angle), radius*cos(angle), 0);
+
+		// Generate a random color
+		particles[particleIndex].r = rand() % 256;
+		particles[particleIndex].g = rand() % 256;
+		particles[particleIndex].b = rand() % 256;
+		particles[particleIndex].a = rand() % 256;
+
+		particles[particleIndex].size = (rand() % 1000) / 2000.0f + 0.1f;
+		particles[particleIndex].size = 0.2f;
+		particles[particleIndex].life = 1000.0f; // This particle will live 5 seconds.
+		particles[particleIndex].asleep = false;
+
+	}
+
+	particles[count - 1].id = count - 1;
+	particles[count - 1].pos = glm::vec3(0, 0, 0);
+	particles[count - 1].speed = glm::vec3(0, 0, 0);
+	particles[count - 1].r = 255;
+	particles[count - 1].g = 255;
+	particles[count - 1].b = 255;
+	particles[count - 1].a = 255;
+	particles[count - 1].size = 0.2f;
+	particles[count - 1].life = 1000.0f;
+	particles[count - 1].asleep = false;
+
+	// The kicks are drawn up front so that every simulation backend applies the same boom
+	for (int i = 0; i < count; i++) {
+		float speed = boomSpeed * pow((rand() % 10000) / 10000.0f, 0.3f);
+		float longitude = 2.0f * 3.1416f * (rand() % 10000) / 10000.0f;
+		float latitude = acos((rand() % 20000 - 10000.0f) / 10000.0f);
+
+		kicks[i] = glm::vec3(
+			speed * sin(longitude) * sin(latitude),
+			speed * cos(longitude) * sin(latitude),
+			speed * cos(latitude)
+		);
+	}
+}
+
+void initParticles(float radius, float angle) {
+	initParticles(ParticlesContainer, BoomKicks, MaxParticles, radius, angle);
+}
+
+void boomParticles(Particle* particles, const glm::vec3* kicks, int count) {
+	for (int i = 0; i < count; i++) {
+		particles[i].speed += kicks[particles[i].id]; // The container may have been sorted since the kicks were drawn
+	}
+}
+
+void boomParticles() {
+	boomParticles(ParticlesContainer, BoomKicks, MaxParticles);
+}
+
+template <typename Precision>
+void stepParticle(BasicParticle<Precision>& p, typename Precision::Time delta, const glm::vec3& center, float radius, float speed, float angle, bool started) {
+	integrateParticle<ActiveForces>(p, delta, makeRotorStep(center, radius, speed, angle), started);
+}
+
+void stepParticle(Particle& p, float delta, float radius, float angle, bool started) {
+	stepParticle(p, delta, glm::vec3(0, 0, 0), radius, centrifugeSpeed, angle, started);
+}
+
+template <typename Precision>
+int simulateParticles(BasicParticle<Precision>* particles, int count, typename Precision::Time delta, float radius, float angle, bool started, const glm::vec3& CameraPosition) {
+
+	RotorStep rotor = makeRotorStep(glm::vec3(0, 0, 0), radius, centrifugeSpeed, angle); // Same for every particle
+
+	int ParticlesCount = 0;
+	for (int i = 0; i < count; i++) {
+		BasicParticle<Precision>& p = particles[i]; // shortcut
+		if (p.life > 0.0f) {
+			p.life -= (float)delta;
+			if (p.life > 0.0f) {
+
+				if (i != count - 1) {
+					integrateParticle<ActiveForces>(p, delta, rotor, started);
+					p.cameradistance = glm::length2(glm::vec3(p.pos) - CameraPosition);
+				}
+
+			}
+			else {
+				// Particles that just died will be put at the end of the buffer in SortParticles();
+				p.cameradistance = -1.0f;
+			}
+
+			ParticlesCount++;
+
+		}
+	}
+	return ParticlesCount;
+}
+
+// Every policy is compiled whatever the one selected, so that none of them rots (and the benchmark can compare them)
+template void stepParticle<FloatPrecision>(BasicParticle<FloatPrecision>&, float, const glm::vec3&, float, float, float, bool);
+template void stepParticle<DoublePrecision>(BasicParticle<DoublePrecision>&, double, const glm::vec3&, float, float, float, bool);
+template void stepParticle<MixedPrecision>(BasicParticle<MixedPrecision>&, double, const glm::vec3&, float, float, float, bool);
+template int simulateParticles<FloatPrecision>(BasicParticle<FloatPrecision>*, int, float, float, float, bool, const glm::vec3&);
+template int simulateParticles<DoublePrecision>(BasicParticle<DoublePrecision>*, int, double, float, float, bool, const glm::vec3&);
+template int simulateParticles<MixedPrecision>(BasicParticle<MixedPrecision>*, int, double, float, float, bool, const glm::vec3&);
+
+int simulateParticles(float delta, float radius, float angle, bool started, const glm::vec3& CameraPosition) {
+	return simulateParticles(ParticlesContainer, MaxParticles, delta, radius, angle, started, CameraPosition);
+}
+
+void SortParticles(Particle* particles, int count) {
+	std::sort(&particles[0], &particles[count]);
+}
+
+void SortParticles() {
+	SortParticles(ParticlesContainer, MaxParticles);
+}
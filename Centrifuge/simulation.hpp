@@ -0,0 +1,90 @@
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+// ********** Precision **********
+// Scalar types of the simulation state. The policy is chosen at compile time : all float by default,
+// CENTRIFUGE_PRECISION_DOUBLE for reference runs, CENTRIFUGE_PRECISION_MIXED for double positions with float
+// speeds and forces, so that long runs of small steps do not lose the position increments.
+// Culling, packing and rendering always work on float copies of the positions.
+struct FloatPrecision {
+	typedef float Position;
+	typedef float Velocity;
+	typedef float Time;
+};
+
+struct DoublePrecision {
+	typedef double Position;
+	typedef double Velocity;
+	typedef double Time;
+};
+
+struct MixedPrecision {
+	typedef double Position;
+	typedef float Velocity;
+	typedef double Time;
+};
+
+#if defined(CENTRIFUGE_PRECISION_DOUBLE)
+typedef DoublePrecision SimulationPrecision;
+#elif defined(CENTRIFUGE_PRECISION_MIXED)
+typedef MixedPrecision SimulationPrecision;
+#else
+typedef FloatPrecision SimulationPrecision;
+#endif
+// ********** Precision **********
+
+// CPU representation of a particle
+template <typename Precision>
+struct BasicParticle {
+	glm::tvec3<typename Precision::Position, glm::highp> pos;
+	glm::tvec3<typename Precision::Velocity, glm::highp> speed;
+	unsigned char r, g, b, a; // Color
+	float size, angle, weight;
+	float life; // Remaining life of the particle. if <0 : dead and unused.
+	float cameradistance; // *Squared* distance to the camera. if dead : -1.0f
+	unsigned short palette; // Index in the color/size palette of the packed instance format
+	bool asleep; // Settled or out of the region of interest : kept and drawn, but not stepped, see sleep.hpp
+	unsigned int id; // Stable index of the particle, keys its static attributes on the GPU
+
+	bool operator<(const BasicParticle& that) const {
+		// Sort in reverse order : far particles drawn first.
+		return this->cameradistance > that.cameradistance;
+	}
+};
+
+typedef BasicParticle<SimulationPrecision> Particle;
+
+// ********** Ʋ **********
+const int MaxParticles = 5000;						// ը
+const float timeRatio = 0.1f;						// ʱ
+const float centrifugeSpeed = 8.0f;					// Ļת(rad/s)
+const float boomSpeed = 20.0f;						// ը(m/s)
+const float gravityAcceleraion = 9.81f * 1;			// ٶ
+constexpr float frictionCoefficient = 0.01f * 0;	// Ħϵ
+// ********** Ʋ **********
+
+extern Particle ParticlesContainer[MaxParticles];
+extern glm::vec3 BoomKicks[MaxParticles];
+
+// Place every particle on the centrifuge and draw the boom kicks
+void initParticles(float radius, float angle);
+// Add the boom kick to every particle, the kicks are indexed by particle ID
+void boomParticles();
+// Advance a single particle by one Euler step (life is handled by the caller)
+void stepParticle(Particle& p, float delta, float radius, float angle, bool started);
+// Same, for a rotor centered on center and turning at speed (rad/s) instead of centrifugeSpeed.
+// Instantiated for the three precision policies in simulation.cpp.
+template <typename Precision>
+void stepParticle(BasicParticle<Precision>& p, typename Precision::Time delta, const glm::vec3& center, float radius, float speed, float angle, bool started);
+// Advance all particles, returns the number of particles still in use
+int simulateParticles(float delta, float radius, float angle, bool started, const glm::vec3& CameraPosition);
+void SortParticles();
+
+// Same as above on any array of particles, the last one being the marker (benchmarks)
+void initParticles(Particle* particles, glm::vec3* kicks, int count, float radius, float angle);
+void boomParticles(Particle* particles, const glm::vec3* kicks, int count);
+template <typename Precision>
+int simulateParticles(BasicParticle<Precision>* particles, int count, typename Precision::Time delta, float radius, float angle, bool started, const glm::vec3& CameraPosition);
+void SortParticles(Particle* particles, int count);
+
+#endif
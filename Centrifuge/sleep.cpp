@@ -0,0 +1,47 @@
+#include <stdio.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "scene.hpp"
+#include "sleep.hpp"
+
+static bool sleepFlag = false;
+static SleepRegion sleepRegion;
+
+void initSleep(const SleepRegion& region) {
+	sleepRegion = region;
+	sleepFlag = true;
+	wakeAllParticles();
+	printf("Sleep : region (%g, %g, %g) to (%g, %g, %g), rest below %g m/s\n",
+		region.low.x, region.low.y, region.low.z, region.high.x, region.high.y, region.high.z, region.restSpeed);
+}
+
+bool isSleepEnabled() {
+	return sleepFlag;
+}
+
+const SleepRegion& getSleepRegion() {
+	return sleepRegion;
+}
+
+int wakeParticles(const glm::vec3& low, const glm::vec3& high) {
+	int woken = 0;
+	for (int i = 0; i < MaxParticles; i++) {
+		Particle& p = ParticlesContainer[i]; // shortcut
+		if (!p.asleep) continue;
+		glm::vec3 pos(p.pos);
+		if (glm::all(glm::greaterThanEqual(pos, low)) && glm::all(glm::lessThanEqual(pos, high))) {
+			p.asleep = false;
+			woken++;
+		}
+	}
+	if (woken > 0) invalidateActiveSet();
+	return woken;
+}
+
+int wakeAllParticles() {
+	return wakeParticles(glm::vec3(-1e30f), glm::vec3(1e30f));
+}
@@ -0,0 +1,46 @@
+#ifndef SLEEP_HPP
+#define SLEEP_HPP
+
+// Sleeping particles : the ones that settled on the floor of the region of interest, or left it.
+// They keep their slot, their state and are still drawn, but simulateScene() no longer steps them :
+// it only walks the active set of scene.hpp, the compact list of the slots of the live, awake particles.
+// The asleep flag lives in the particle, so the history saves and restores it with the rest of the state.
+
+// Region of interest. Its floor is the plane z = low.z, where the falling particles come to rest.
+struct SleepRegion {
+	glm::vec3 low, high;
+	float restSpeed; // A particle on the floor slower than this (m/s) goes to sleep
+};
+
+const float floorRestitution = 0.3f; // Vertical speed kept by a bounce on the floor
+const float floorFriction = 0.2f; // Horizontal speed lost at each contact with the floor
+
+// Enable the sleeping with this region, only for the CPU simulation. Wakes every particle.
+void initSleep(const SleepRegion& region);
+bool isSleepEnabled();
+const SleepRegion& getSleepRegion();
+
+// Wake the sleeping particles inside [low, high], or all of them. Returns the number of particles woken.
+// The ones still outside the region or resting on the floor fall asleep again within a few steps.
+int wakeParticles(const glm::vec3& low, const glm::vec3& high);
+int wakeAllParticles();
+
+// Called after each step of a flying particle : bounce it on the floor, returns TRUE if it should go to sleep
+inline bool settleParticle(Particle& p, const SleepRegion& region) {
+	glm::vec3 pos(p.pos); // Float whatever the simulation precision
+	if (pos.x < region.low.x || pos.y < region.low.y || pos.x > region.high.x || pos.y > region.high.y || pos.z > region.high.z) {
+		return true; // Left the region of interest : frozen where it left
+	}
+	if (pos.z > region.low.z) return false;
+
+	// On the floor : each contact slows the particle down, until it rests
+	p.pos.z = region.low.z;
+	if (p.speed.z < 0) p.speed.z = -floorRestitution * p.speed.z;
+	p.speed.x *= 1.0f - floorFriction;
+	p.speed.y *= 1.0f - floorFriction;
+	if (glm::length(glm::vec3(p.speed)) >= region.restSpeed) return false;
+	p.speed = glm::vec3(0, 0, 0);
+	return true;
+}
+
+#endif
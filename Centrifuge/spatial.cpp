@@ -0,0 +1,300 @@
+#include <math.h>
+#include <vector>
+#include <queue>
+#include <algorithm>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "spatial.hpp"
+
+const unsigned int NoParticle = 0xFFFFFFFF;
+const int MinQueryChunk = 16; // Queries per chunk of the batches, each one visits many particles
+const float MaxCell = 1073741824.0f; // 2^30 : cell coordinates are clamped to +-MaxCell, beyond it the conversion to int is undefined
+
+static const Particle* indexedParticles = NULL; // Array of the last update, for the current positions
+static int indexedArrayCount = 0;
+static float cellSize = 1.0f;
+static float margin = 0.25f;
+
+// Per particle ID
+static std::vector<glm::vec3> indexedPositions; // Position at the build
+static std::vector<glm::ivec3> indexedCells;
+static std::vector<int> slots; // Index in the array, -1 if the particle was dead at the build
+
+// Hashed grid : the IDs of the particles hashed to bucket b are cellIds[cellStart[b], cellStart[b + 1])
+static std::vector<int> cellStart;
+static std::vector<unsigned int> cellIds;
+static unsigned int tableMask = 0;
+static int indexedCount = 0;
+static glm::vec3 indexedLow(0.0f), indexedHigh(0.0f); // Bounds of the live particles at the build
+
+// Cell coordinate of a float one, clamped : the cells stay in order, so a box still visits every particle inside it.
+// NaN goes to 0, it is inside no box anyway.
+static int clampCell(float cell) {
+	return cell == cell ? (int)std::min(std::max(cell, -MaxCell), MaxCell) : 0;
+}
+
+static glm::ivec3 getCell(const glm::vec3& pos) {
+	glm::vec3 cell = glm::floor(pos / cellSize);
+	return glm::ivec3(clampCell(cell.x), clampCell(cell.y), clampCell(cell.z));
+}
+
+static unsigned int hashCell(const glm::ivec3& cell) {
+	return ((unsigned int)cell.x * 73856093u ^ (unsigned int)cell.y * 19349663u ^ (unsigned int)cell.z * 83492791u) & tableMask;
+}
+
+void buildSpatialIndex(const Particle* particles, int count, float size, float indexMargin) {
+	indexedParticles = particles;
+	indexedArrayCount = count;
+
+	unsigned int maxId = 0;
+	int live = 0;
+	glm::vec3 low(1e30f), high(-1e30f);
+	for (int i = 0; i < count; i++) {
+		maxId = std::max(maxId, particles[i].id);
+		if (particles[i].life <= 0.0f) continue;
+		live++;
+		low = glm::min(low, glm::vec3(particles[i].pos));
+		high = glm::max(high, glm::vec3(particles[i].pos));
+	}
+	indexedCount = live;
+	indexedLow = low;
+	indexedHigh = high;
+
+	if (size <= 0.0f) {
+		// About 8 particles per cell if the cloud filled its bounding box
+		glm::vec3 extent = glm::max(high - low, glm::vec3(1e-3f));
+		size = live > 0 ? (float)cbrt(8.0 * extent.x * extent.y * extent.z / live) : 1.0f;
+	}
+	cellSize = std::max(size, 1e-3f);
+	margin = indexMargin < 0.0f ? 0.25f * cellSize : indexMargin;
+
+	unsigned int tableSize = 64;
+	while (tableSize < 2u * (unsigned int)live) tableSize *= 2;
+	tableMask = tableSize - 1;
+
+	indexedPositions.resize(maxId + 1);
+	indexedCells.resize(maxId + 1);
+	slots.assign(maxId + 1, -1);
+	std::vector<unsigned int> buckets(count);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) {
+				buckets[i] = NoParticle;
+				continue;
+			}
+			indexedPositions[p.id] = p.pos;
+			indexedCells[p.id] = getCell(p.pos);
+			slots[p.id] = i;
+			buckets[i] = hashCell(indexedCells[p.id]);
+		}
+	});
+
+	// Counting sort by bucket, a few microseconds for the cloud sizes of the simulation
+	cellStart.assign(tableSize + 1, 0);
+	for (int i = 0; i < count; i++) {
+		if (buckets[i] != NoParticle) cellStart[buckets[i] + 1]++;
+	}
+	for (unsigned int b = 0; b < tableSize; b++) cellStart[b + 1] += cellStart[b];
+	cellIds.resize(live);
+	std::vector<int> next(cellStart.begin(), cellStart.end() - 1);
+	for (int i = 0; i < count; i++) {
+		if (buckets[i] != NoParticle) cellIds[next[buckets[i]]++] = particles[i].id;
+	}
+}
+
+bool updateSpatialIndex(const Particle* particles, int count) {
+	if (count != indexedArrayCount || (cellIds.empty() && count > 0)) {
+		buildSpatialIndex(particles, count, cellSize, margin);
+		return true;
+	}
+	indexedParticles = particles;
+
+	// Relocate every particle, and check none of them went beyond the margin or came to life
+	float margin2 = margin * margin;
+	std::vector<char> stale(getChunkCount(count), 0);
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		bool chunkStale = false;
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.id >= slots.size()) {
+				chunkStale = true;
+				continue;
+			}
+			bool indexed = slots[p.id] >= 0;
+			slots[p.id] = indexed ? i : -1;
+			if (p.life <= 0.0f) continue; // Dead particles are skipped by the queries
+			glm::vec3 moved = glm::vec3(p.pos) - indexedPositions[p.id];
+			if (!indexed || glm::dot(moved, moved) > margin2) chunkStale = true;
+		}
+		stale[chunk] = chunkStale;
+	});
+
+	if (std::find(stale.begin(), stale.end(), 1) == stale.end()) return false;
+	buildSpatialIndex(particles, count, cellSize, margin);
+	return true;
+}
+
+void cleanupSpatialIndex() {
+	indexedParticles = NULL;
+	indexedArrayCount = 0;
+	indexedCount = 0;
+	std::vector<glm::vec3>().swap(indexedPositions);
+	std::vector<glm::ivec3>().swap(indexedCells);
+	std::vector<int>().swap(slots);
+	std::vector<int>().swap(cellStart);
+	std::vector<unsigned int>().swap(cellIds);
+}
+
+int getIndexedCount() {
+	return indexedCount;
+}
+
+// Call visit(id, particle) for every live particle that may be inside [low, high] :
+// the cells covering the box grown by the margin, or every particle if that is fewer.
+// Returns FALSE if nothing could be outside of the visited cells (every particle visited).
+template <typename Visitor>
+static bool visitCandidates(const glm::vec3& low, const glm::vec3& high, const Visitor& visit) {
+	// The range is measured in floating point : far or infinite boxes cover more cells than an int holds
+	glm::dvec3 firstCell = glm::floor(glm::dvec3(low - glm::vec3(margin)) / (double)cellSize);
+	glm::dvec3 lastCell = glm::floor(glm::dvec3(high + glm::vec3(margin)) / (double)cellSize);
+	glm::dvec3 extent = glm::max(lastCell - firstCell + 1.0, glm::dvec3(0.0));
+	double cells = extent.x * extent.y * extent.z;
+	bool finite = glm::all(glm::lessThan(glm::abs(firstCell), glm::dvec3(INFINITY))) && glm::all(glm::lessThan(glm::abs(lastCell), glm::dvec3(INFINITY)));
+
+	// NaN or infinite bounds, or more cells than particles : every particle
+	if (!finite || cells >= (double)cellIds.size()) {
+		for (size_t e = 0; e < cellIds.size(); e++) {
+			unsigned int id = cellIds[e];
+			const Particle& p = indexedParticles[slots[id]]; // shortcut
+			if (p.life > 0.0f) visit(id, p);
+		}
+		return false;
+	}
+
+	glm::ivec3 first = getCell(low - glm::vec3(margin));
+	glm::ivec3 last = getCell(high + glm::vec3(margin));
+	glm::ivec3 cell;
+	for (cell.z = first.z; cell.z <= last.z; cell.z++) {
+		for (cell.y = first.y; cell.y <= last.y; cell.y++) {
+			for (cell.x = first.x; cell.x <= last.x; cell.x++) {
+				unsigned int bucket = hashCell(cell);
+				for (int e = cellStart[bucket]; e < cellStart[bucket + 1]; e++) {
+					unsigned int id = cellIds[e];
+					if (indexedCells[id] != cell) continue; // Another cell in the same bucket
+					const Particle& p = indexedParticles[slots[id]]; // shortcut
+					if (p.life > 0.0f) visit(id, p);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+int countInRadius(const glm::vec3& center, float radius) {
+	if (indexedParticles == NULL) return 0;
+	int found = 0;
+	float radius2 = radius * radius;
+	visitCandidates(center - glm::vec3(radius), center + glm::vec3(radius), [&](unsigned int id, const Particle& p) {
+		glm::vec3 d = glm::vec3(p.pos) - center;
+		if (glm::dot(d, d) <= radius2) found++;
+	});
+	return found;
+}
+
+int findNearest(const glm::vec3& center, int k, unsigned int* ids, float* distances) {
+	if (indexedParticles == NULL || k <= 0) return 0;
+	if (!glm::all(glm::lessThan(glm::abs(center), glm::vec3(INFINITY)))) return 0; // No distance to a NaN or infinite center
+
+	// Max-heap of the k nearest so far, grown with the search radius until it holds k particles within it.
+	// The search starts at the bounds of the particles, and stops growing once it holds them all.
+	std::priority_queue<std::pair<float, unsigned int> > nearest;
+	glm::vec3 boundsLow = indexedLow - glm::vec3(margin), boundsHigh = indexedHigh + glm::vec3(margin);
+	float radius = std::max(cellSize, glm::length(center - glm::clamp(center, boundsLow, boundsHigh)));
+	for (;;) {
+		while (!nearest.empty()) nearest.pop();
+		float radius2 = radius * radius;
+		bool partial = visitCandidates(center - glm::vec3(radius), center + glm::vec3(radius), [&](unsigned int id, const Particle& p) {
+			glm::vec3 d = glm::vec3(p.pos) - center;
+			float d2 = glm::dot(d, d);
+			if (d2 > radius2) return;
+			if ((int)nearest.size() < k) nearest.push(std::make_pair(d2, id));
+			else if (d2 < nearest.top().first) {
+				nearest.pop();
+				nearest.push(std::make_pair(d2, id));
+			}
+		});
+		if ((int)nearest.size() == k || !partial) break;
+		bool covered = glm::all(glm::lessThanEqual(center - glm::vec3(radius), boundsLow)) &&
+			glm::all(glm::greaterThanEqual(center + glm::vec3(radius), boundsHigh));
+		if (covered) break;
+		radius *= 2.0f;
+	}
+	// With every particle visited, the ones beyond the radius are still missing
+	if ((int)nearest.size() < k && indexedCount > (int)nearest.size()) {
+		while (!nearest.empty()) nearest.pop();
+		for (size_t e = 0; e < cellIds.size(); e++) {
+			const Particle& p = indexedParticles[slots[cellIds[e]]]; // shortcut
+			if (p.life <= 0.0f) continue;
+			glm::vec3 d = glm::vec3(p.pos) - center;
+			float d2 = glm::dot(d, d);
+			if ((int)nearest.size() < k) nearest.push(std::make_pair(d2, cellIds[e]));
+			else if (d2 < nearest.top().first) {
+				nearest.pop();
+				nearest.push(std::make_pair(d2, cellIds[e]));
+			}
+		}
+	}
+
+	int found = (int)nearest.size();
+	for (int n = found - 1; n >= 0; n--) {
+		ids[n] = nearest.top().second;
+		if (distances != NULL) distances[n] = sqrt(nearest.top().first);
+		nearest.pop();
+	}
+	return found;
+}
+
+int findInBox(const glm::vec3& low, const glm::vec3& high, unsigned int* ids, int maxIds) {
+	if (indexedParticles == NULL) return 0;
+	int found = 0;
+	visitCandidates(low, high, [&](unsigned int id, const Particle& p) {
+		glm::vec3 pos(p.pos);
+		if (glm::all(glm::greaterThanEqual(pos, low)) && glm::all(glm::lessThanEqual(pos, high))) {
+			if (found < maxIds) ids[found] = id;
+			found++;
+		}
+	});
+	return found;
+}
+
+void countInRadiusBatch(const glm::vec3* centers, const float* radii, int queryCount, int* counts) {
+	parallelFor(queryCount, [&](int begin, int end, int chunk) {
+		for (int q = begin; q < end; q++) counts[q] = countInRadius(centers[q], radii[q]);
+	}, MinQueryChunk);
+}
+
+void findNearestBatch(const glm::vec3* centers, int queryCount, int k, unsigned int* ids, float* distances) {
+	parallelFor(queryCount, [&](int begin, int end, int chunk) {
+		for (int q = begin; q < end; q++) {
+			unsigned int* queryIds = ids + (size_t)q * k;
+			float* queryDistances = distances != NULL ? distances + (size_t)q * k : NULL;
+			int found = findNearest(centers[q], k, queryIds, queryDistances);
+			for (int n = found; n < k; n++) {
+				queryIds[n] = NoParticle;
+				if (queryDistances != NULL) queryDistances[n] = -1.0f;
+			}
+		}
+	}, MinQueryChunk);
+}
+
+void countInBoxBatch(const glm::vec3* lows, const glm::vec3* highs, int queryCount, int* counts) {
+	parallelFor(queryCount, [&](int begin, int end, int chunk) {
+		for (int q = begin; q < end; q++) counts[q] = findInBox(lows[q], highs[q], NULL, 0);
+	}, MinQueryChunk);
+}
@@ -0,0 +1,34 @@
+#ifndef SPATIAL_HPP
+#define SPATIAL_HPP
+
+// Spatial queries over the live particles, through a hashed uniform grid.
+// Results are particle IDs, which survive SortParticles(), distances are measured on the current positions.
+//
+// The grid is not rebuilt every step : a particle is found as long as it moved less than margin since the build,
+// the queries look margin further. updateSpatialIndex() only rebuilds once a particle went beyond it.
+// Queries may run concurrently, but not while the index is built or updated.
+
+// Index the live particles of the array. cellSize <= 0 picks one from the density of the cloud,
+// margin < 0 is a quarter of the cell.
+void buildSpatialIndex(const Particle* particles, int count, float cellSize = 0.0f, float margin = -1.0f);
+// Follow the particles of the array (which may have been sorted since), returns TRUE if it had to rebuild
+bool updateSpatialIndex(const Particle* particles, int count);
+void cleanupSpatialIndex();
+// Number of particles indexed, the live ones at the last update
+int getIndexedCount();
+
+// Particles within radius of center
+int countInRadius(const glm::vec3& center, float radius);
+// IDs of the k nearest particles, nearest first, returns how many were found (< k if there are fewer particles,
+// 0 if center is NaN or infinite). Far or infinite boxes and radii are valid, they visit every particle.
+int findNearest(const glm::vec3& center, int k, unsigned int* ids, float* distances = NULL);
+// IDs of the particles inside [low, high], up to maxIds of them, returns how many are inside
+int findInBox(const glm::vec3& low, const glm::vec3& high, unsigned int* ids, int maxIds);
+
+// Batches, the queries are spread over the worker threads.
+// findNearestBatch writes k IDs (and distances) per query, padded with 0xFFFFFFFF (and -1).
+void countInRadiusBatch(const glm::vec3* centers, const float* radii, int queryCount, int* counts);
+void findNearestBatch(const glm::vec3* centers, int queryCount, int k, unsigned int* ids, float* distances = NULL);
+void countInBoxBatch(const glm::vec3* lows, const glm::vec3* highs, int queryCount, int* counts);
+
+#endif
@@ -0,0 +1,188 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "stream.hpp"
+
+const size_t StreamAlignment = 64; // Cache line, also enough for any SIMD load of the readers
+
+static bool streamFlag = false;
+static StreamHeader* header = NULL;
+static unsigned char* segment = NULL; // Same address as header
+static size_t segmentSize = 0;
+static std::string segmentName;
+static unsigned long long frameNumber = 0;
+static std::vector<int> chunkCounts;
+#ifdef _WIN32
+static HANDLE mapping = NULL;
+#endif
+
+static size_t alignUp(size_t size) {
+	return (size + StreamAlignment - 1) / StreamAlignment * StreamAlignment;
+}
+
+// ********** Shared memory **********
+static bool createSegment(const char* name, size_t size) {
+#ifdef _WIN32
+	// Local\ : visible to the processes of the same session, released with the last handle
+	segmentName = std::string("Local\\") + name;
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, segmentName.c_str());
+	if (mapping == NULL) return false;
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		// Still mapped by a reader of a previous run, with its old size and content
+		CloseHandle(mapping);
+		mapping = NULL;
+		return false;
+	}
+	segment = (unsigned char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (segment == NULL) {
+		CloseHandle(mapping);
+		mapping = NULL;
+		return false;
+	}
+#else
+	// A stale segment of a crashed run may have another size : start from a new one
+	segmentName = std::string("/") + name;
+	shm_unlink(segmentName.c_str());
+	int fd = shm_open(segmentName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) return false;
+	if (ftruncate(fd, (off_t)size) != 0) {
+		close(fd);
+		shm_unlink(segmentName.c_str());
+		return false;
+	}
+	void* address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd); // The mapping keeps the segment
+	if (address == MAP_FAILED) {
+		shm_unlink(segmentName.c_str());
+		return false;
+	}
+	segment = (unsigned char*)address;
+#endif
+	segmentSize = size;
+	return true;
+}
+
+static void destroySegment() {
+#ifdef _WIN32
+	UnmapViewOfFile(segment);
+	CloseHandle(mapping);
+	mapping = NULL;
+#else
+	munmap(segment, segmentSize);
+	shm_unlink(segmentName.c_str());
+#endif
+	segment = NULL;
+	segmentSize = 0;
+}
+// ********** Shared memory **********
+
+bool initStream(const char* name, int capacity, int slotCount) {
+	if (streamFlag) cleanupStream();
+	slotCount = std::max(2, std::min(slotCount, MaxStreamSlots));
+	size_t arraySize = alignUp((size_t)capacity * 4);
+	size_t slotStride = arraySize * StreamArrayCount;
+	size_t slotOffset = alignUp(sizeof(StreamHeader));
+	if (!createSegment(name, slotOffset + slotStride * slotCount)) {
+		fprintf(stderr, "Failed to create the shared memory stream %s\n", name);
+		return false;
+	}
+
+	// A new segment is zero filled : no frame published, every slot complete
+	header = (StreamHeader*)segment;
+	header->version = StreamVersion;
+	header->slotCount = slotCount;
+	header->capacity = capacity;
+	header->slotOffset = slotOffset;
+	header->slotStride = slotStride;
+	for (int a = 0; a < StreamArrayCount; a++) header->arrayOffset[a] = a * arraySize;
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = StreamMagic;
+
+	frameNumber = 0;
+	streamFlag = true;
+	printf("Stream : %d particles x %d frames in shared memory %s (%.1f MB)\n", capacity, slotCount, segmentName.c_str(), segmentSize / 1048576.0);
+	return true;
+}
+
+bool isStreamEnabled() {
+	return streamFlag;
+}
+
+void publishStream(const Particle* particles, int count, long long step, double time, float angle) {
+	if (!streamFlag) return;
+	count = std::min(count, (int)header->capacity);
+	frameNumber++;
+	int slotIndex = (int)((frameNumber - 1) % header->slotCount);
+	StreamSlot& slot = header->slots[slotIndex]; // shortcut
+	unsigned char* base = segment + header->slotOffset + slotIndex * header->slotStride;
+	float* arrays[StreamArrayCount];
+	for (int a = 0; a < StreamArrayCount; a++) arrays[a] = (float*)(base + header->arrayOffset[a]);
+	unsigned int* ids = (unsigned int*)arrays[StreamId];
+
+	// Odd : the readers of the previous frame of this slot see that it is being overwritten
+	slot.sequence.store(2 * frameNumber - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	// Each chunk writes its live particles at the start of its own range, then they are packed together
+	chunkCounts.resize(getChunkCount(count));
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		int written = begin;
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			if (p.life <= 0.0f) continue;
+			arrays[StreamPosX][written] = (float)p.pos.x;
+			arrays[StreamPosY][written] = (float)p.pos.y;
+			arrays[StreamPosZ][written] = (float)p.pos.z;
+			arrays[StreamSpeedX][written] = (float)p.speed.x;
+			arrays[StreamSpeedY][written] = (float)p.speed.y;
+			arrays[StreamSpeedZ][written] = (float)p.speed.z;
+			arrays[StreamLife][written] = p.life;
+			ids[written] = p.id;
+			written++;
+		}
+		chunkCounts[chunk] = written - begin;
+	});
+	int chunks = (int)chunkCounts.size();
+	int total = 0;
+	for (int c = 0; c < chunks; c++) {
+		int begin = getChunkBegin(count, chunks, c);
+		if (begin != total) {
+			for (int a = 0; a < StreamArrayCount; a++) memmove(arrays[a] + total, arrays[a] + begin, chunkCounts[c] * sizeof(float));
+		}
+		total += chunkCounts[c];
+	}
+
+	slot.step = step;
+	slot.time = time;
+	slot.count = total;
+	slot.angle = angle;
+	slot.sequence.store(2 * frameNumber, std::memory_order_release);
+	header->published.store(frameNumber, std::memory_order_release);
+}
+
+void cleanupStream() {
+	if (!streamFlag) return;
+	streamFlag = false;
+	header = NULL;
+	destroySegment();
+	std::vector<int>().swap(chunkCounts);
+}
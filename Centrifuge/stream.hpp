@@ -0,0 +1,69 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <atomic>
+
+// Live particle state for external tools (Python, Julia...) : every simulated frame is published as plain arrays,
+// one per field, in a named shared memory segment (POSIX shm_open, a named file mapping on Windows).
+// A local process maps the segment read-only and wraps the arrays without copying them, e.g. numpy.frombuffer.
+//
+// The segment is a ring of slotCount frames. The publisher never waits for the readers : it writes frame n into
+// slot (n - 1) % slotCount, whoever is reading it. Each slot carries a sequence number, a seqlock :
+//   sequence == 2n - 1 while frame n is written, 2n once it is complete.
+// To read the latest frame :
+//   n = published (acquire); slot = (n - 1) % slotCount
+//   s = slot.sequence (acquire), retry if s != 2n
+//   use the arrays of the slot
+//   s again (after an acquire fence) : if it changed, the frame was overwritten meanwhile and must be dropped.
+// A reader has slotCount - 1 frames of time before its slot is reused.
+//
+// Layout, little endian, all offsets in bytes from the start of the segment :
+//   0    StreamHeader (640 bytes), see below
+//   slotOffset + s * slotStride + arrayOffset[a] : array a of slot s, capacity 4-byte items, 64-byte aligned
+// Only the first count items of each array are valid : the live particles, in container order, which changes
+// with the back to front sort. The id array follows a particle from frame to frame.
+
+// Arrays of a slot, all float except StreamId
+enum StreamArray {
+	StreamPosX, StreamPosY, StreamPosZ, // m, float whatever the simulation precision
+	StreamSpeedX, StreamSpeedY, StreamSpeedZ, // m/s
+	StreamLife, // Remaining life, s
+	StreamId, // unsigned int, stable index of the particle
+	StreamArrayCount
+};
+
+const unsigned int StreamMagic = 0x4D525453; // "STRM"
+const unsigned int StreamVersion = 1;
+const int MaxStreamSlots = 16;
+
+struct StreamSlot {
+	std::atomic<unsigned long long> sequence; // Offset 0
+	long long step; // Offset 8 : simulation substep of the frame
+	double time; // Offset 16 : simulated seconds since the start of the program
+	unsigned int count; // Offset 24 : valid items in each array
+	float angle; // Offset 28 : rotor angle of group 0, radians
+};
+
+struct StreamHeader {
+	unsigned int magic, version; // Offsets 0, 4 : magic is written last, the header is valid once it is set
+	unsigned int slotCount, capacity; // Offsets 8, 12
+	unsigned long long slotOffset, slotStride; // Offsets 16, 24
+	unsigned long long arrayOffset[StreamArrayCount]; // Offset 32
+	std::atomic<unsigned long long> published; // Offset 96 : latest complete frame, 0 : none yet
+	unsigned long long reserved[3];
+	StreamSlot slots[MaxStreamSlots]; // Offset 128, 32 bytes each
+};
+
+static_assert(sizeof(std::atomic<unsigned long long>) == 8, "The stream layout needs 8-byte atomics");
+static_assert(sizeof(StreamSlot) == 32 && sizeof(StreamHeader) == 640, "The stream layout is read by other languages");
+
+// Create (or replace) the segment name, without the leading slash, for capacity particles and slotCount frames.
+// Returns false if the segment cannot be created.
+bool initStream(const char* name, int capacity, int slotCount);
+bool isStreamEnabled();
+// Write the live particles as frame n + 1 into the next slot, in parallel. Only the calling thread publishes.
+void publishStream(const Particle* particles, int count, long long step, double time, float angle);
+// Unmap and remove the segment, the readers keep their mapping until they close it
+void cleanupStream();
+
+#endif
@@ -1,89 +1,303 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #include <GL/glew.h>
 
 #include <glfw3.h>
 
+#include "texture.hpp"
+
+// ********** Memory mapped files **********
+struct MappedFile {
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+};
+
+static bool mapFile(const char* path, MappedFile& mapped) {
+	mapped.data = NULL;
+	mapped.size = 0;
+#ifdef _WIN32
+	mapped.file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (mapped.file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	GetFileSizeEx(mapped.file, &size);
+	mapped.size = (size_t)size.QuadPart;
+	mapped.mapping = mapped.size > 0 ? CreateFileMappingA(mapped.file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	if (mapped.mapping == NULL) {
+		CloseHandle(mapped.file);
+		return false;
+	}
+	mapped.data = (const unsigned char*)MapViewOfFile(mapped.mapping, FILE_MAP_READ, 0, 0, 0);
+	if (mapped.data == NULL) {
+		CloseHandle(mapped.mapping);
+		CloseHandle(mapped.file);
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+	mapped.size = (size_t)info.st_size;
+	void* data = mmap(NULL, mapped.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // The mapping keeps its own reference
+	if (data == MAP_FAILED) return false;
+	madvise(data, mapped.size, MADV_SEQUENTIAL);
+	mapped.data = (const unsigned char*)data;
+#endif
+	return true;
+}
 
-GLuint loadBMP_custom(const char * imagepath) {
-
-	printf("Reading image %s\n", imagepath);
+static void unmapFile(MappedFile& mapped) {
+	if (mapped.data == NULL) return;
+#ifdef _WIN32
+	UnmapViewOfFile(mapped.data);
+	CloseHandle(mapped.mapping);
+	CloseHandle(mapped.file);
+#else
+	munmap((void*)mapped.data, mapped.size);
+#endif
+	mapped.data = NULL;
+}
+// ********** Memory mapped files **********
 
-	// Data read from the header of the BMP file
-	unsigned char header[54];
-	unsigned int dataPos;
-	unsigned int imageSize;
+// A texture parsed from a mapped file, ready to be uploaded : every level points into the mapping
+struct TextureLevel {
 	unsigned int width, height;
-	// Actual RGB data
-	unsigned char * data;
+	size_t offset, size; // In the file
+};
 
-	// Open the file
-	FILE * file = fopen(imagepath, "rb");
-	if (!file) { printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar(); return 0; }
+struct ParsedTexture {
+	int handle; // Slot of the asynchronous loader, -1 for the blocking loaders
+	std::string path;
+	MappedFile file;
+	bool compressed;
+	GLenum format; // Compressed format, or the pixel format of the uncompressed data
+	std::vector<TextureLevel> levels;
+};
 
-	// Read the header, i.e. the 54 first bytes
+static bool readBMP(const char* imagepath, ParsedTexture& texture) {
+	const unsigned char* header = texture.file.data;
 
 	// If less than 54 bytes are read, problem
-	if (fread(header, 1, 54, file) != 54) {
+	if (texture.file.size < 54) {
 		printf("Not a correct BMP file\n");
-		return 0;
+		return false;
 	}
 	// A BMP files always begins with "BM"
 	if (header[0] != 'B' || header[1] != 'M') {
 		printf("Not a correct BMP file\n");
-		return 0;
+		return false;
 	}
 	// Make sure this is a 24bpp file
-	if (*(int*)&(header[0x1E]) != 0) { printf("Not a correct BMP file\n");    return 0; }
-	if (*(int*)&(header[0x1C]) != 24) { printf("Not a correct BMP file\n");    return 0; }
+	if (*(int*)&(header[0x1E]) != 0) { printf("Not a correct BMP file\n");    return false; }
+	if (*(int*)&(header[0x1C]) != 24) { printf("Not a correct BMP file\n");    return false; }
 
 	// Read the information about the image
-	dataPos = *(int*)&(header[0x0A]);
-	imageSize = *(int*)&(header[0x22]);
-	width = *(int*)&(header[0x12]);
-	height = *(int*)&(header[0x16]);
+	unsigned int dataPos = *(int*)&(header[0x0A]);
+	unsigned int imageSize = *(int*)&(header[0x22]);
+	unsigned int width = *(int*)&(header[0x12]);
+	unsigned int height = *(int*)&(header[0x16]);
 
 	// Some BMP files are misformatted, guess missing information
-	if (imageSize == 0)    imageSize = width*height * 3; // 3 : one byte for each Red, Green and Blue component
+	if (imageSize == 0)    imageSize = ((width * 3 + 3) & ~3) * height; // 3 : one byte for each Red, Green and Blue component, rows padded to 4 bytes
 	if (dataPos == 0)      dataPos = 54; // The BMP header is done that way
 
-										 // Create a buffer
-	data = new unsigned char[imageSize];
+	if ((size_t)dataPos + imageSize > texture.file.size) {
+		printf("%s is truncated\n", imagepath);
+		return false;
+	}
+
+	texture.compressed = false;
+	texture.format = GL_BGR;
+	TextureLevel level = { width, height, dataPos, imageSize };
+	texture.levels.push_back(level);
+	return true;
+}
+
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+
+static bool readDDS(const char* imagepath, ParsedTexture& texture) {
+
+	/* verify the type of file */
+	if (texture.file.size < 128 || strncmp((const char*)texture.file.data, "DDS ", 4) != 0) {
+		printf("%s is not a DDS file\n", imagepath);
+		return false;
+	}
 
-	// Read the actual data from the file into the buffer
-	fread(data, 1, imageSize, file);
+	/* get the surface desc */
+	const unsigned char* header = texture.file.data + 4;
 
-	// Everything is in memory now, the file wan be closed
-	fclose(file);
+	unsigned int height = *(unsigned int*)&(header[8]);
+	unsigned int width = *(unsigned int*)&(header[12]);
+	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
+	unsigned int fourCC = *(unsigned int*)&(header[80]);
+
+	switch (fourCC)
+	{
+	case FOURCC_DXT1:
+		texture.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		break;
+	case FOURCC_DXT3:
+		texture.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		break;
+	case FOURCC_DXT5:
+		texture.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		break;
+	default:
+		printf("%s : unsupported DDS format\n", imagepath);
+		return false;
+	}
+	texture.compressed = true;
+
+	/* walk the mip chain, it stops at the end of the file */
+	unsigned int blockSize = (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
+	size_t offset = 128;
+	if (mipMapCount == 0) mipMapCount = 1;
+	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+	{
+		size_t size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
+		if (offset + size > texture.file.size) break;
+		TextureLevel textureLevel = { width, height, offset, size };
+		texture.levels.push_back(textureLevel);
+
+		offset += size;
+		width /= 2;
+		height /= 2;
+
+		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
+		if (width < 1) width = 1;
+		if (height < 1) height = 1;
+	}
+	if (texture.levels.empty()) {
+		printf("%s is truncated\n", imagepath);
+		return false;
+	}
+	return true;
+}
+
+// Map and parse a file, BMP or DDS depending on its first bytes. Runs on any thread.
+static bool readTexture(const char* imagepath, ParsedTexture& texture) {
+	texture.levels.clear();
+	if (!mapFile(imagepath, texture.file)) {
+		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath);
+		return false;
+	}
+	bool ok = texture.file.size >= 2 && texture.file.data[0] == 'B' && texture.file.data[1] == 'M'
+		? readBMP(imagepath, texture)
+		: readDDS(imagepath, texture);
+	if (!ok) {
+		unmapFile(texture.file);
+		return false;
+	}
+
+	// Fault the pages in now, so that the copy on the GL thread never waits for the disk
+	volatile unsigned char touch = 0;
+	size_t end = texture.levels.back().offset + texture.levels.back().size;
+	for (size_t i = texture.levels[0].offset; i < end; i += 4096) touch += texture.file.data[i];
+	return true;
+}
+
+// Upload through a pixel buffer object, then release the mapping. GL thread only.
+// Reuses textureID if not 0, so that a reloaded texture keeps its name.
+static GLuint uploadTexture(ParsedTexture& texture, GLuint textureID) {
+	static GLuint uploadBuffer = 0;
+	if (uploadBuffer == 0) glGenBuffers(1, &uploadBuffer);
+
+	size_t begin = texture.levels[0].offset;
+	size_t size = texture.levels.back().offset + texture.levels.back().size - begin;
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploadBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (staging == NULL) {
+		printf("Failed to map the texture upload buffer\n");
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		unmapFile(texture.file);
+		return textureID;
+	}
+	memcpy(staging, texture.file.data + begin, size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	unmapFile(texture.file);
 
 	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
+	if (textureID == 0) glGenTextures(1, &textureID);
 
 	// "Bind" the newly created texture : all future texture functions will modify this texture
 	glBindTexture(GL_TEXTURE_2D, textureID);
 
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+	if (texture.compressed) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+		/* load the mipmaps */
+		for (size_t level = 0; level < texture.levels.size(); ++level)
+		{
+			const TextureLevel& l = texture.levels[level];
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, texture.format, l.width, l.height,
+				0, (GLsizei)l.size, (void*)(l.offset - begin));
+		}
+	} else {
+		// BMP rows are padded to 4 bytes
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		// Give the image to OpenGL
+		const TextureLevel& l = texture.levels[0];
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, l.width, l.height, 0, texture.format, GL_UNSIGNED_BYTE, (void*)0);
+
+		// Poor filtering, or ...
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
+
+		// ... nice trilinear filtering.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
 
-	// OpenGL has now copied the data. Free our own version
-	delete[] data;
+	// Return the ID of the texture we just created
+	return textureID;
+}
 
-	// Poor filtering, or ...
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	//glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); 
+GLuint loadBMP_custom(const char * imagepath) {
 
-	// ... nice trilinear filtering.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
+	printf("Reading image %s\n", imagepath);
 
-	// Return the ID of the texture we just created
-	return textureID;
+	ParsedTexture texture;
+	texture.handle = -1;
+	if (!readTexture(imagepath, texture)) return 0;
+	if (texture.compressed) {
+		printf("Not a correct BMP file\n");
+		unmapFile(texture.file);
+		return 0;
+	}
+	return uploadTexture(texture, 0);
 }
 
 // Since GLFW 3, glfwLoadTexture2D() has been removed. You have to use another texture loading library, 
@@ -113,99 +327,156 @@ GLuint loadBMP_custom(const char * imagepath) {
 
 
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
-
 GLuint loadDDS(const char * imagepath) {
 
-	unsigned char header[124];
-
-	FILE *fp;
-
-	/* try to open the file */
-	fp = fopen(imagepath, "rb");
-	if (fp == NULL) {
-		printf("%s could not be opened. Are you in the right directory ? Don't forget to read the FAQ !\n", imagepath); getchar();
-		return 0;
-	}
-
-	/* verify the type of file */
-	char filecode[4];
-	fread(filecode, 1, 4, fp);
-	if (strncmp(filecode, "DDS ", 4) != 0) {
-		fclose(fp);
+	ParsedTexture texture;
+	texture.handle = -1;
+	if (!readTexture(imagepath, texture)) return 0;
+	if (!texture.compressed) {
+		printf("%s is not a DDS file\n", imagepath);
+		unmapFile(texture.file);
 		return 0;
 	}
+	return uploadTexture(texture, 0);
+}
 
-	/* get the surface desc */
-	fread(&header, 124, 1, fp);
+// ********** Asynchronous loader **********
+struct TextureSlot {
+	std::string path;
+	long long modified; // Modification time of the file the texture was loaded from
+	GLuint texture; // 0 until the first upload, then kept while a newer version loads
+	bool loading;
+	bool failed;
+};
+
+static std::vector<TextureSlot> textureSlots; // GL thread only
+static std::thread textureThread;
+static std::mutex textureMutex;
+static std::condition_variable textureCondition;
+static std::deque<ParsedTexture> textureRequests; // Only the handle and the path are set
+static std::deque<ParsedTexture> texturesParsed;
+static bool textureThreadStop = false;
+
+static long long getModificationTime(const char* path) {
+	struct stat info;
+	if (stat(path, &info) != 0) return -1;
+	return (long long)info.st_mtime;
+}
 
-	unsigned int height = *(unsigned int*)&(header[8]);
-	unsigned int width = *(unsigned int*)&(header[12]);
-	unsigned int linearSize = *(unsigned int*)&(header[16]);
-	unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-	unsigned int fourCC = *(unsigned int*)&(header[80]);
+static void textureLoop() {
+	for (;;) {
+		ParsedTexture texture;
+		{
+			std::unique_lock<std::mutex> lock(textureMutex);
+			textureCondition.wait(lock, [] { return textureThreadStop || !textureRequests.empty(); });
+			if (textureThreadStop) return;
+			texture = textureRequests.front();
+			textureRequests.pop_front();
+		}
+
+		printf("Reading image %s\n", texture.path.c_str());
+		if (!readTexture(texture.path.c_str(), texture)) {
+			texture.levels.clear(); // Failed, the GL thread only marks the slot
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(textureMutex);
+			texturesParsed.push_back(texture);
+		}
+		textureCondition.notify_all(); // Wakes up waitForTexture()
+	}
+}
 
+int requestTexture(const char* imagepath) {
+	long long modified = getModificationTime(imagepath);
 
-	unsigned char * buffer;
-	unsigned int bufsize;
-	/* how big is it going to be including all mipmaps? */
-	bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-	buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-	fread(buffer, 1, bufsize, fp);
-	/* close the file pointer */
-	fclose(fp);
+	int handle = -1;
+	for (size_t i = 0; i < textureSlots.size(); i++) {
+		if (textureSlots[i].path == imagepath) {
+			handle = (int)i;
+			break;
+		}
+	}
+	if (handle >= 0) {
+		TextureSlot& slot = textureSlots[handle];
+		// Cache hit : same file, same version
+		if (slot.loading || (slot.modified == modified && !slot.failed)) return handle;
+	} else {
+		TextureSlot slot;
+		slot.path = imagepath;
+		slot.texture = 0;
+		textureSlots.push_back(slot);
+		handle = (int)textureSlots.size() - 1;
+	}
+	TextureSlot& slot = textureSlots[handle];
+	slot.modified = modified;
+	slot.loading = true;
+	slot.failed = false;
 
-	unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-	unsigned int format;
-	switch (fourCC)
 	{
-	case FOURCC_DXT1:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-		break;
-	case FOURCC_DXT3:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-		break;
-	case FOURCC_DXT5:
-		format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-		break;
-	default:
-		free(buffer);
-		return 0;
+		std::lock_guard<std::mutex> lock(textureMutex);
+		if (!textureThread.joinable()) {
+			textureThreadStop = false;
+			textureThread = std::thread(textureLoop);
+		}
+		ParsedTexture request;
+		request.handle = handle;
+		request.path = slot.path;
+		textureRequests.push_back(request);
 	}
+	textureCondition.notify_one();
+	return handle;
+}
 
-	// Create one OpenGL texture
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-	unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-	unsigned int offset = 0;
-
-	/* load the mipmaps */
-	for (unsigned int level = 0; level < mipMapCount && (width || height); ++level)
+void updateTextures() {
+	std::deque<ParsedTexture> parsed;
 	{
-		unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-		glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-			0, size, buffer + offset);
-
-		offset += size;
-		width /= 2;
-		height /= 2;
-
-		// Deal with Non-Power-Of-Two textures. This code is not included in the webpage to reduce clutter.
-		if (width < 1) width = 1;
-		if (height < 1) height = 1;
-
+		std::lock_guard<std::mutex> lock(textureMutex);
+		parsed.swap(texturesParsed);
 	}
+	for (size_t i = 0; i < parsed.size(); i++) {
+		TextureSlot& slot = textureSlots[parsed[i].handle];
+		slot.loading = false;
+		if (parsed[i].levels.empty()) {
+			slot.failed = true;
+			continue;
+		}
+		slot.texture = uploadTexture(parsed[i], slot.texture);
+	}
+}
 
-	free(buffer);
-
-	return textureID;
+GLuint getTexture(int handle) {
+	if (handle < 0) return 0;
+	return textureSlots[handle].texture;
+}
 
+GLuint waitForTexture(int handle) {
+	if (handle < 0) return 0;
+	while (textureSlots[handle].loading) {
+		{
+			std::unique_lock<std::mutex> lock(textureMutex);
+			textureCondition.wait_for(lock, std::chrono::milliseconds(1), [] { return !texturesParsed.empty(); });
+		}
+		updateTextures();
+	}
+	return textureSlots[handle].texture;
+}
 
-}
\ No newline at end of file
+void cleanupTextures() {
+	if (textureThread.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(textureMutex);
+			textureThreadStop = true;
+		}
+		textureCondition.notify_all();
+		textureThread.join();
+	}
+	for (size_t i = 0; i < texturesParsed.size(); i++) unmapFile(texturesParsed[i].file);
+	texturesParsed.clear();
+	textureRequests.clear();
+	for (size_t i = 0; i < textureSlots.size(); i++) {
+		if (textureSlots[i].texture != 0) glDeleteTextures(1, &textureSlots[i].texture);
+	}
+	textureSlots.clear();
+}
+// ********** Asynchronous loader **********
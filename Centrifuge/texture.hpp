@@ -12,5 +12,19 @@ GLuint loadBMP_custom(const char * imagepath);
 // Load a .DDS file using GLFW's own loader
 GLuint loadDDS(const char * imagepath);
 
+// Asynchronous loading of .BMP and .DDS files : a worker thread maps and parses the file,
+// updateTextures() uploads it through a pixel buffer object.
+// Textures are cached by path and modification time : requesting an unchanged file again is free,
+// a modified one is reloaded into the same texture name.
+// Returns a handle. If the file cannot be loaded, getTexture() stays at 0.
+int requestTexture(const char * imagepath);
+// Upload the textures parsed since the last call. GL thread, once per frame.
+void updateTextures();
+// 0 until the first version is uploaded
+GLuint getTexture(int handle);
+// Block until the pending version is uploaded
+GLuint waitForTexture(int handle);
+void cleanupTextures();
 
-#endif
\ No newline at end of file
+
+#endif
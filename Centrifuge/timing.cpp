@@ -0,0 +1,236 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "timing.hpp"
+
+const int TimingLatency = 4; // Frames a GPU result may lag behind before endFrameTiming() waits for it
+const int TimingWindow = 256; // Frames in the rolling percentiles
+
+static const char* phaseNames[PhaseCount] = {
+	"simulate", "sort", "fill", "wait", "upload", "draw", "swap", "total", "gpu_simulate", "gpu_upload", "gpu_draw"
+};
+
+// One frame, from its first measure until all of its GPU queries have landed
+struct FrameRecord {
+	long long frame;
+	double times[PhaseCount]; // Seconds
+	bool measured[PhaseCount];
+	GLuint queries[PhaseCount]; // Only the GPU phases use theirs
+	bool pending; // Closed, waiting for its GPU results
+};
+
+static bool timingEnabled = false;
+static FrameRecord records[TimingLatency];
+static int currentRecord = 0;
+static long long frameNumber = 0;
+static long long reportedFrames = 0;
+static int reportEvery = 0;
+static double lastFrameEnd = 0.0;
+static int openGpuPhase = -1;
+
+// Rolling window per phase, only fed with the frames that measured it
+static double history[PhaseCount][TimingWindow];
+static int historyCount[PhaseCount];
+static int historyNext[PhaseCount];
+
+static FILE* logFile = NULL;
+static bool jsonLog = false;
+
+double getTimerSeconds() {
+	static const std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+}
+
+static void resetRecord(FrameRecord& record) {
+	record.frame = frameNumber;
+	for (int i = 0; i < PhaseCount; i++) {
+		record.times[i] = 0.0;
+		record.measured[i] = false;
+	}
+	record.pending = false;
+}
+
+bool initFrameTiming(const char* logPath, int reportInterval) {
+	if (logPath != NULL) {
+		logFile = fopen(logPath, "w");
+		if (logFile == NULL) {
+			printf("Impossible to open the timing log %s\n", logPath);
+			return false;
+		}
+		size_t length = strlen(logPath);
+		jsonLog = length >= 5 && strcmp(logPath + length - 5, ".json") == 0;
+		if (jsonLog) {
+			fprintf(logFile, "[\n");
+		} else {
+			fprintf(logFile, "frame");
+			for (int i = 0; i < PhaseCount; i++) fprintf(logFile, ",%s", phaseNames[i]);
+			fprintf(logFile, "\n");
+		}
+	}
+
+	for (int r = 0; r < TimingLatency; r++) {
+		glGenQueries(PhaseCount, records[r].queries);
+		resetRecord(records[r]);
+	}
+	for (int i = 0; i < PhaseCount; i++) {
+		historyCount[i] = 0;
+		historyNext[i] = 0;
+	}
+	currentRecord = 0;
+	frameNumber = 0;
+	reportedFrames = 0;
+	reportEvery = reportInterval;
+	openGpuPhase = -1;
+	lastFrameEnd = getTimerSeconds();
+	timingEnabled = true;
+	return true;
+}
+
+bool isFrameTimingEnabled() {
+	return timingEnabled;
+}
+
+void addPhaseTime(TimingPhase phase, double seconds) {
+	if (!timingEnabled) return;
+	FrameRecord& record = records[currentRecord];
+	record.times[phase] += seconds;
+	record.measured[phase] = true;
+}
+
+void beginGpuPhase(TimingPhase phase) {
+	if (!timingEnabled || openGpuPhase >= 0) return;
+	FrameRecord& record = records[currentRecord];
+	if (record.measured[phase]) return; // One query per phase and per frame
+	glBeginQuery(GL_TIME_ELAPSED, record.queries[phase]);
+	record.measured[phase] = true;
+	openGpuPhase = phase;
+}
+
+void endGpuPhase() {
+	if (!timingEnabled || openGpuPhase < 0) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	openGpuPhase = -1;
+}
+
+static bool areResultsAvailable(const FrameRecord& record) {
+	for (int i = PhaseGpuSimulate; i < PhaseCount; i++) {
+		if (!record.measured[i]) continue;
+		GLuint available = 0;
+		glGetQueryObjectuiv(record.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) return false;
+	}
+	return true;
+}
+
+// Nearest rank percentile of a sorted array
+static double percentile(const std::vector<double>& sorted, double p) {
+	int rank = (int)ceil(p * sorted.size()) - 1;
+	return sorted[std::max(0, std::min((int)sorted.size() - 1, rank))];
+}
+
+static void printReport() {
+	printf("Frame timing over the last %d frames (ms, p50 / p95 / p99)\n", (int)std::min((long long)TimingWindow, reportedFrames));
+	std::vector<double> sorted;
+	for (int i = 0; i < PhaseCount; i++) {
+		if (historyCount[i] == 0) continue;
+		sorted.assign(history[i], history[i] + historyCount[i]);
+		std::sort(sorted.begin(), sorted.end());
+		printf("  %-12s %8.3f / %8.3f / %8.3f\n", phaseNames[i],
+			1000.0 * percentile(sorted, 0.50), 1000.0 * percentile(sorted, 0.95), 1000.0 * percentile(sorted, 0.99));
+	}
+}
+
+// Read the GPU results (waiting for them if they are not there yet), then feed the statistics and the log
+static void finishRecord(FrameRecord& record) {
+	for (int i = PhaseGpuSimulate; i < PhaseCount; i++) {
+		if (!record.measured[i]) continue;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(record.queries[i], GL_QUERY_RESULT, &elapsed);
+		record.times[i] = elapsed * 1e-9;
+	}
+
+	for (int i = 0; i < PhaseCount; i++) {
+		if (!record.measured[i]) continue;
+		history[i][historyNext[i]] = record.times[i];
+		historyNext[i] = (historyNext[i] + 1) % TimingWindow;
+		historyCount[i] = std::min(historyCount[i] + 1, TimingWindow);
+	}
+
+	if (logFile != NULL) {
+		// Milliseconds, phases not measured this frame are left empty (CSV) or null (JSON)
+		if (jsonLog) {
+			fprintf(logFile, "%s{\"frame\": %lld", reportedFrames > 0 ? ",\n" : "", record.frame);
+			for (int i = 0; i < PhaseCount; i++) {
+				if (record.measured[i]) fprintf(logFile, ", \"%s\": %.4f", phaseNames[i], 1000.0 * record.times[i]);
+				else fprintf(logFile, ", \"%s\": null", phaseNames[i]);
+			}
+			fprintf(logFile, "}");
+		} else {
+			fprintf(logFile, "%lld", record.frame);
+			for (int i = 0; i < PhaseCount; i++) {
+				if (record.measured[i]) fprintf(logFile, ",%.4f", 1000.0 * record.times[i]);
+				else fprintf(logFile, ",");
+			}
+			fprintf(logFile, "\n");
+		}
+	}
+
+	record.pending = false;
+	reportedFrames++;
+	if (reportEvery > 0 && reportedFrames % reportEvery == 0) {
+		printReport();
+	}
+}
+
+void endFrameTiming() {
+	if (!timingEnabled) return;
+	endGpuPhase();
+
+	double now = getTimerSeconds();
+	addPhaseTime(PhaseFrame, now - lastFrameEnd);
+	lastFrameEnd = now;
+	records[currentRecord].pending = true;
+
+	// Oldest first, so that the log stays in frame order
+	for (int k = 1; k <= TimingLatency; k++) {
+		FrameRecord& record = records[(currentRecord + k) % TimingLatency];
+		if (!record.pending) continue;
+		if (!areResultsAvailable(record)) break;
+		finishRecord(record);
+	}
+
+	frameNumber++;
+	currentRecord = (currentRecord + 1) % TimingLatency;
+	// The GPU is more than TimingLatency frames behind : the oldest record has to be finished now
+	if (records[currentRecord].pending) {
+		finishRecord(records[currentRecord]);
+	}
+	resetRecord(records[currentRecord]);
+}
+
+void cleanupFrameTiming() {
+	if (!timingEnabled) return;
+	endGpuPhase();
+
+	for (int k = 1; k <= TimingLatency; k++) {
+		FrameRecord& record = records[(currentRecord + k) % TimingLatency];
+		if (record.pending) finishRecord(record);
+	}
+	for (int r = 0; r < TimingLatency; r++) {
+		glDeleteQueries(PhaseCount, records[r].queries);
+	}
+	if (reportedFrames > 0) printReport();
+
+	if (logFile != NULL) {
+		if (jsonLog) fprintf(logFile, "\n]\n");
+		fclose(logFile);
+		logFile = NULL;
+	}
+	timingEnabled = false;
+}
@@ -0,0 +1,39 @@
+#ifndef TIMING_HPP
+#define TIMING_HPP
+
+// Phases of a frame. The CPU ones are measured with a high resolution clock, the GPU ones with GL_TIME_ELAPSED queries.
+enum TimingPhase {
+	PhaseSimulate,    // simulateParticles(), or the submission of the GPU step
+	PhaseSort,        // SortParticles()
+	PhaseFill,        // Culling and instance staging fill
+	PhaseWait,        // GL thread waiting for the simulation thread (pipelined mode)
+	PhaseUpload,      // Instance buffer orphaning and glBufferSubData
+	PhaseDraw,        // Draw calls submission
+	PhaseSwap,        // glfwSwapBuffers and glfwPollEvents
+	PhaseFrame,       // Whole frame, from swap to swap
+	PhaseGpuSimulate, // GPU time of the transform feedback step
+	PhaseGpuUpload,   // GPU time of the instance upload
+	PhaseGpuDraw,     // GPU time of the draw calls
+	PhaseCount
+};
+
+// Seconds since an arbitrary origin, from a monotonic high resolution clock
+double getTimerSeconds();
+
+// logPath : per-frame log, a JSON array if it ends with ".json", CSV otherwise. NULL : no log.
+// reportInterval : print the rolling p50/p95/p99 every this many frames, 0 : only at cleanup.
+// Needs a current GL context. Until it is called, every other function does nothing.
+bool initFrameTiming(const char* logPath, int reportInterval);
+// Wait for the queries in flight, print the last percentiles and close the log
+void cleanupFrameTiming();
+bool isFrameTimingEnabled();
+
+// CPU time of a phase of the current frame, in seconds. Adds up if called several times in the same frame.
+void addPhaseTime(TimingPhase phase, double seconds);
+// GL_TIME_ELAPSED query around GL commands, only one can be open at a time
+void beginGpuPhase(TimingPhase phase);
+void endGpuPhase();
+// Close the current frame. The GPU results are read back a few frames later, once available, without stalling.
+void endFrameTiming();
+
+#endif
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include <GL/glew.h>
+
+// Include GLM
+#include <glm/glm.hpp>
+using namespace glm;
+
+#include "shader.hpp"
+#include "simulation.hpp"
+#include "parallel.hpp"
+#include "scene.hpp"
+#include "trails.hpp"
+
+static int trailLength = 0;
+static int trailHead = -1; // Slot of the newest sample
+static int trailSamples = 0;
+static double trailTimes[MaxTrailLength]; // Simulated time of each slot
+
+void initTrails(int length) {
+	trailLength = length > 0 ? std::max(2, std::min(length, MaxTrailLength)) : 0;
+	resetTrails();
+	if (trailLength > 0) {
+		printf("Trails : %d samples per particle, %.1f MB\n", trailLength, 3.0 * trailLength * MaxParticles * sizeof(float) / (1024.0 * 1024.0));
+	}
+}
+
+bool isTrailsEnabled() {
+	return trailLength > 0;
+}
+
+int recordTrails(const Particle* particles, int count, double time, float* sample) {
+	trailHead = (trailHead + 1) % trailLength;
+	trailSamples = std::min(trailSamples + 1, trailLength);
+	trailTimes[trailHead] = time;
+
+	float* x = sample;
+	float* y = x + MaxParticles;
+	float* z = y + MaxParticles;
+	parallelFor(count, [&](int begin, int end, int chunk) {
+		for (int i = begin; i < end; i++) {
+			const Particle& p = particles[i]; // shortcut
+			x[p.id] = p.pos.x;
+			y[p.id] = p.pos.y;
+			z[p.id] = p.pos.z;
+		}
+	});
+	return trailHead;
+}
+
+void resetTrails() {
+	trailHead = -1;
+	trailSamples = 0;
+}
+
+int getTrailSamples() {
+	return trailSamples;
+}
+
+int getTrailHead() {
+	return trailHead;
+}
+
+void getTrailAges(float* ages) {
+	for (int slot = 0; slot < MaxTrailLength; slot++) {
+		// In double until the difference : the simulated time grows without bound
+		ages[slot] = slot < trailLength && trailHead >= 0 ? (float)(trailTimes[trailHead] - trailTimes[slot]) : 0.0f;
+	}
+}
+
+static GLuint trailProgramID = 0;
+static GLuint trailBuffer = 0, trailTexture = 0;
+static GLint TrailSamplerID, TrailLengthID, ParticleCountID, HeadID, SamplesID, SampleAgeID, RotatingID, TrailVPID;
+static GLint GroupCountID, GroupFirstID, GroupCenterID, GroupSpeedID;
+
+bool initTrailRenderer() {
+	trailProgramID = LoadShaders("Trail.vertexshader", "Trail.fragmentshader");
+	if (trailProgramID == 0) {
+		fprintf(stderr, "Failed to build the trail program\n");
+		return false;
+	}
+	TrailSamplerID = glGetUniformLocation(trailProgramID, "trailSampler");
+	TrailLengthID = glGetUniformLocation(trailProgramID, "trailLength");
+	ParticleCountID = glGetUniformLocation(trailProgramID, "particleCount");
+	HeadID = glGetUniformLocation(trailProgramID, "head");
+	SamplesID = glGetUniformLocation(trailProgramID, "samples");
+	SampleAgeID = glGetUniformLocation(trailProgramID, "sampleAge");
+	RotatingID = glGetUniformLocation(trailProgramID, "rotating");
+	TrailVPID = glGetUniformLocation(trailProgramID, "VP");
+	GroupCountID = glGetUniformLocation(trailProgramID, "groupCount");
+	GroupFirstID = glGetUniformLocation(trailProgramID, "groupFirst");
+	GroupCenterID = glGetUniformLocation(trailProgramID, "groupCenter");
+	GroupSpeedID = glGetUniformLocation(trailProgramID, "groupSpeed");
+
+	// Allocated once, only one slot is written per frame. The shader never reads a slot before it is written.
+	glGenBuffers(1, &trailBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, trailBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, (size_t)3 * trailLength * MaxParticles * sizeof(float), NULL, GL_DYNAMIC_DRAW);
+	glGenTextures(1, &trailTexture);
+	glBindTexture(GL_TEXTURE_BUFFER, trailTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, trailBuffer);
+	return true;
+}
+
+void uploadTrails(int slot, const float* sample) {
+	if (slot < 0) return;
+	size_t plane = (size_t)trailLength * MaxParticles;
+	size_t offset = (size_t)slot * MaxParticles;
+	glBindBuffer(GL_TEXTURE_BUFFER, trailBuffer);
+	for (int k = 0; k < 3; k++) {
+		glBufferSubData(GL_TEXTURE_BUFFER, (k * plane + offset) * sizeof(float), MaxParticles * sizeof(float), sample + (size_t)k * MaxParticles);
+	}
+}
+
+void drawTrails(const glm::mat4& ViewProjectionMatrix, int head, int samples, const float* ages, bool rotating) {
+	if (samples < 2) return;
+
+	// The ranges, centers and speeds of the rotors never change after initScene()
+	int groupFirst[MaxGroups];
+	glm::vec3 groupCenter[MaxGroups];
+	float groupSpeed[MaxGroups];
+	int groupCount = getGroupCount();
+	for (int g = 0; g < groupCount; g++) {
+		const CentrifugeGroup& group = getGroup(g); // shortcut
+		groupFirst[g] = group.first; // The particle IDs of a group follow its range, see initScene()
+		groupCenter[g] = group.center;
+		groupSpeed[g] = group.speed;
+	}
+
+	glUseProgram(trailProgramID);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, trailTexture);
+	glUniform1i(TrailSamplerID, 0);
+	glUniform1i(TrailLengthID, trailLength);
+	glUniform1i(ParticleCountID, MaxParticles);
+	glUniform1i(HeadID, head);
+	glUniform1i(SamplesID, samples);
+	glUniform1fv(SampleAgeID, trailLength, ages);
+	glUniform1i(GroupCountID, groupCount);
+	glUniform1iv(GroupFirstID, groupCount, groupFirst);
+	glUniform3fv(GroupCenterID, groupCount, &groupCenter[0][0]);
+	glUniform1fv(GroupSpeedID, groupCount, groupSpeed);
+	glUniform1i(RotatingID, rotating ? 1 : 0);
+	glUniformMatrix4fv(TrailVPID, 1, GL_FALSE, &ViewProjectionMatrix[0][0]);
+
+	// Blended over the particles, without hiding what is drawn after them
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);
+	glDrawArraysInstanced(GL_LINE_STRIP, 0, samples, MaxParticles);
+	glDepthMask(GL_TRUE);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+void cleanupTrails() {
+	if (trailProgramID != 0) {
+		glDeleteTextures(1, &trailTexture);
+		glDeleteBuffers(1, &trailBuffer);
+		glDeleteProgram(trailProgramID);
+		trailProgramID = 0;
+	}
+	trailLength = 0;
+}
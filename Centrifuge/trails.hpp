@@ -0,0 +1,35 @@
+#ifndef TRAILS_HPP
+#define TRAILS_HPP
+
+// Particle trails : the last positions of every particle, in a ring of samples taken once per frame.
+// Each sample is three planes (x, y and z of every particle, by ID), so that the newest sample is uploaded
+// as three contiguous blocks. The ring itself only lives on the GPU : the simulation writes each sample into
+// a buffer of its frame, and the GL thread uploads it from there, so that they never share memory.
+const int MaxTrailLength = 64;
+
+// length samples per particle (2 to MaxTrailLength), 0 disables the trails
+void initTrails(int length);
+bool isTrailsEnabled();
+// Take the position of every particle as the next slot of the ring, time is the simulated time of the sample.
+// sample : 3 * MaxParticles floats, the x, y and z planes to upload. Returns the slot taken.
+int recordTrails(const Particle* particles, int count, double time, float* sample);
+// Forget the samples, e.g. after a jump in time
+void resetTrails();
+// Samples in the ring, at most the trail length
+int getTrailSamples();
+// Slot of the newest sample
+int getTrailHead();
+// Simulated seconds from each slot to the newest one, MaxTrailLength of them
+void getTrailAges(float* ages);
+
+// GL side, on the GL thread
+bool initTrailRenderer();
+// Upload the sample of one slot, the only part of the ring that changed since the last frame
+void uploadTrails(int slot, const float* sample);
+// One instanced line strip per particle, newest sample first, fading with age.
+// In the rotating view each sample is turned about the center of its own rotor (see scene.hpp),
+// by the angle that rotor turned since the sample was taken.
+void drawTrails(const glm::mat4& ViewProjectionMatrix, int head, int samples, const float* ages, bool rotating);
+void cleanupTrails();
+
+#endif